@@ -1,7 +1,19 @@
 #include "button.h"
 #include <printf.h>
+#include <irq.h>
+
 uint32_t read_button()
 {
     printf("get button\n");
    // return mips_get_word(BUTTON_ADDR, NULL);
-}
\ No newline at end of file
+}
+
+static void button_irq(void *arg)
+{
+}
+
+// 按键接在 IRQ_BUTTON 上，中断来了只计数：次数由 irq_run 记在 irq_table[IRQ_BUTTON] 里
+void button_init()
+{
+    irq_register(IRQ_BUTTON, button_irq, NULL, 0, "button");
+}
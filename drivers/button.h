@@ -3,3 +3,5 @@
 #include <mips/cpu.h>
 
 uint32_t read_button();
+
+void button_init();
@@ -2,170 +2,76 @@
 
 #include <mips/cpu.h>
 #include <mfp_io.h>
+#include <ktimer.h>
+
+#define BEAT_MS 400 // 一拍的时长
 
 void set_buzzers(u32 v)
 {
     mips_put_word(BUZZER_ADDR,v);
 }
-void delay_zero()
-{
-    volatile unsigned int j = 0;
-    for (; j < 2500000; j++);
-
-}
-/**
- * 播放Do音符（262Hz）
- *
- * 向蜂鸣器写入Do音的频率值（0x00000106）
- * 延时控制音符持续时长
- * 结束后停止发声
- */
-void delay_do()
-{
-    set_buzzers(0x00000106);  // Do: 262Hz
-
-    volatile unsigned int j = 0;
-    for (; j < 2500000; j++);  // 延时控制音符时长
-
-    set_buzzers(0);  // 停止发声
-}
-/**
- * 播放Re音符（294Hz）
- */
-void delay_re()
-{
-    set_buzzers(0x00000126);  // Re: 294Hz
 
-    volatile unsigned int j = 0;
-    for (; j < 2500000; j++);
-
-    set_buzzers(0);
-}
-/**
- * 播放Mi音符（330Hz）
+/*
+ * 乐曲播放不再用忙等延时：每个音符开始时设好蜂鸣器频率，再挂一个
+ * 内核定时器（lib/ktimer.c），到期回调里换下一个音符，调用者立即返回。
+ * 回调由时钟中断推动（推迟到工作队列里执行），所以需要先 kclock_init 开了时钟中断才会往下放。
  */
-void delay_mi()
-{
-    set_buzzers(0x0000014A);  // Mi: 330Hz
-
-    volatile unsigned int j = 0;
-    for (; j < 2500000; j++);
+static struct ktimer buzzer_timer;
+static const struct buzzer_note *buzzer_song;
+static int buzzer_len;
+static int buzzer_pos;
 
-    set_buzzers(0);
-}
-/**
- * 播放长Mi音符（330Hz，时长加倍）
- */
-void delay_long_mi()
+static void buzzer_next(void *arg)
 {
-    set_buzzers(0x0000014A);  // Mi: 330Hz
-
-    volatile unsigned int j = 0;
-    for (; j < 5000000; j++);  // 延时加倍，实现长音符
-
-    set_buzzers(0);
+    if (buzzer_pos >= buzzer_len) {
+        set_buzzers(NOTE_STOP);  // 停止发声
+        buzzer_song = NULL;
+        return;
+    }
+    set_buzzers(buzzer_song[buzzer_pos].freq);
+    ktimer_add_ms(&buzzer_timer, buzzer_song[buzzer_pos].beats * BEAT_MS, buzzer_next, NULL);
+    buzzer_pos++;
 }
-/**
- * 播放Fa音符（349Hz）
- */
-void delay_fa()
-{
-    set_buzzers(0x0000015D);  // Fa: 349Hz
-
-    volatile unsigned int j = 0;
-    for (; j < 2500000; j++);
 
-    set_buzzers(0);
-}
 /**
- * 播放So音符（392Hz）
+ * 开始播放 n 个音符的乐曲 song（非阻塞），会打断正在播放的乐曲
+ * song 必须在播放期间保持有效
  */
-void delay_so()
+void buzzer_play(const struct buzzer_note *song, int n)
 {
-    set_buzzers(0x00000188);  // So: 392Hz
-
-    volatile unsigned int j = 0;
-    for (; j < 2500000; j++);
-
-    set_buzzers(0);
+    ktimer_cancel(&buzzer_timer);
+    buzzer_song = song;
+    buzzer_len = n;
+    buzzer_pos = 0;
+    buzzer_next(NULL);
 }
-/**
- * 播放La音符（440Hz）
- */
-void delay_la()
-{
-    set_buzzers(0x000001B8);  // La: 440Hz
 
-    volatile unsigned int j = 0;
-    for (; j < 2500000; j++);
-
-    set_buzzers(0);
-}
-/**
- *播放Xi音符（494Hz）
- */
-void delay_xi()
+// 是否还在播放
+int buzzer_busy(void)
 {
-    set_buzzers(0x000001EE);  // Xi: 494Hz
-
-    volatile unsigned int j = 0;
-    for (; j < 2500000; j++);
-
-    set_buzzers(0);
+    return buzzer_song != NULL;
 }
 
-//0
-//1 262 0x00000106
-//2 294 0x00000126
-//3 330 0x0000014A
-//4 349 0x0000015D
-//5 392 0x00000188
-//6 440 0x000001B8
-//7 494 0x000001EE
-
 void start_ringtone()
 {
     //SONG OF JOY
-    delay_xi();
-    delay_zero();
-    delay_mi();
-    delay_mi();
-    delay_fa();
-    delay_so();
-    delay_zero();
-    delay_so();
-    delay_fa();
-    delay_mi();
-    delay_re();
-    delay_zero();
-    delay_do();
-    delay_do();
-    delay_re();
-    delay_mi();
-    delay_zero();
-    delay_long_mi();
-    delay_re();
-    delay_re();
+    static const struct buzzer_note song[] = {
+        {NOTE_XI, 1}, {NOTE_STOP, 1}, {NOTE_MI, 1}, {NOTE_MI, 1}, {NOTE_FA, 1},
+        {NOTE_SO, 1}, {NOTE_STOP, 1}, {NOTE_SO, 1}, {NOTE_FA, 1}, {NOTE_MI, 1},
+        {NOTE_RE, 1}, {NOTE_STOP, 1}, {NOTE_DO, 1}, {NOTE_DO, 1}, {NOTE_RE, 1},
+        {NOTE_MI, 1}, {NOTE_STOP, 1}, {NOTE_MI, 2}, {NOTE_RE, 1}, {NOTE_RE, 1},
+    };
+    buzzer_play(song, sizeof(song) / sizeof(song[0]));
 }
 
 void boot_music()
 {
     //1233 5661 1321 123
-    delay_do();
-    delay_mi();
-    delay_re();
-    delay_mi();
-    delay_mi();
-    delay_so();
-    delay_la();
-    delay_la();
-    delay_do();
-    delay_zero();
-    delay_do();
-    delay_mi();
-    delay_re();
-    delay_do();
-    delay_do();
-    delay_re();
-    delay_mi();
+    static const struct buzzer_note song[] = {
+        {NOTE_DO, 1}, {NOTE_MI, 1}, {NOTE_RE, 1}, {NOTE_MI, 1}, {NOTE_MI, 1},
+        {NOTE_SO, 1}, {NOTE_LA, 1}, {NOTE_LA, 1}, {NOTE_DO, 1}, {NOTE_STOP, 1},
+        {NOTE_DO, 1}, {NOTE_MI, 1}, {NOTE_RE, 1}, {NOTE_DO, 1}, {NOTE_DO, 1},
+        {NOTE_RE, 1}, {NOTE_MI, 1},
+    };
+    buzzer_play(song, sizeof(song) / sizeof(song[0]));
 }
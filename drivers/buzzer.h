@@ -2,14 +2,24 @@
 
 #include <types.h>
 
+// 蜂鸣器频率控制值
+#define NOTE_STOP 0x00000000
+#define NOTE_DO   0x00000106  // 262Hz
+#define NOTE_RE   0x00000126  // 294Hz
+#define NOTE_MI   0x0000014A  // 330Hz
+#define NOTE_FA   0x0000015D  // 349Hz
+#define NOTE_SO   0x00000188  // 392Hz
+#define NOTE_LA   0x000001B8  // 440Hz
+#define NOTE_XI   0x000001EE  // 494Hz
+
+struct buzzer_note
+{
+    u32 freq;  // NOTE_*，NOTE_STOP 表示休止
+    u32 beats; // 持续几拍
+};
+
 void set_buzzers(u32 v);
+void buzzer_play(const struct buzzer_note *song, int n);
+int buzzer_busy(void);
 void start_ringtone();
-void delay_zero();
-void delay_do();
-void delay_re();
-void delay_mi();
-void delay_long_mi();
-void delay_fa();
-void delay_so();
-void delay_la();
-void delay_xi();
\ No newline at end of file
+void boot_music();
\ No newline at end of file
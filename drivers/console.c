@@ -4,11 +4,54 @@
 
 #include "vga_print.h"
 
+#include <mips/cpu.h>
+#include <string.h>
+#include <printf.h>
+#include <env.h>
+#include <sched.h>
+#include <irq.h>
+#include <workq.h>
+
 static void cons_intr(int (*proc)(void));
 static void cons_putc(int c);
+static void cons_rx(void *arg);
+
+// 接收中断只把字符收进 cons，行编辑和回显推迟到 cons_rx_work 里做
+static struct workq cons_wq;
+static struct work cons_rx_work = WORK_INIT(cons_rx, NULL);
 
 /***** Serial I/O code *****/
 
+/*
+ * 发送环形缓冲区：cons_putc 只把字符放进 txring，由 UART 的 THRE 中断（serial_irq）
+ * 一次搬最多 UART_FIFO_DEPTH 个字节到发送 FIFO。内核大部分时间 EXL=1、中断不进来，
+ * 所以 serial_putc 入队时如果发送 FIFO 已经空了，也顺手搬一批，不等中断。
+ * 只有缓冲区满时才会等 UART 腾出空间；panic 之后（cons_flush_sync）改为逐字符同步输出。
+ */
+#define TXBUFSIZE 4096
+
+static struct {
+    u8 buf[TXBUFSIZE]; // buffer
+    u32 rpos;          // 下一个要送进 THR 的位置
+    u32 wpos;          // write position
+} txring;
+
+static int tx_irq_on;      // IER 中 ETBEI 是否打开
+static int cons_sync_mode; // panic 之后为 1，不再经过缓冲区
+static u32 cons_tx_stalls; // 缓冲区满、只能等 UART 的次数
+
+// 关中断，返回原来的 Status；和 page_zero_refill 中的写法一致
+static u32 cons_irq_save(void) {
+    u32 status;
+    asm volatile("di %0\n\tehb" : "=r"(status) : : "memory");
+    return status;
+}
+
+static void cons_irq_restore(u32 status) {
+    if (status & SR_IE)
+        asm volatile("ei\n\tehb" : : : "memory");
+}
+
 static int serial_proc_data(void) {
     if (!get_UART_DR(get_UART_LSR())) // get when data is ready
         return -1;
@@ -19,13 +62,102 @@ void serial_intr(void) {
     cons_intr(serial_proc_data);
 }
 
-static void serial_putc(int c) {
-    while (!get_UART_TEMT(get_UART_LSR()));
+// 发送 FIFO 空了就从 txring 搬一批；缓冲区空了关掉发送中断，否则打开，等下一次 THRE
+static void serial_tx_fill(void) {
+    int n;
+
+    if (txring.rpos != txring.wpos && get_UART_THRE(get_UART_LSR())) {
+        for (n = 0; n < UART_FIFO_DEPTH && txring.rpos != txring.wpos; n++) {
+            set_UART_THR(txring.buf[txring.rpos % TXBUFSIZE]);
+            txring.rpos++;
+        }
+    }
+    if (txring.rpos == txring.wpos) {
+        if (tx_irq_on) {
+            set_UART_IER(ERBFI);
+            tx_irq_on = 0;
+        }
+    } else if (!tx_irq_on) {
+        set_UART_IER(ERBFI | ETBEI);
+        tx_irq_on = 1;
+    }
+}
+
+static void serial_putc_sync(int c) {
+    while (!get_UART_THRE(get_UART_LSR()));
     set_UART_THR(c);
 }
 
+static void serial_putc(int c) {
+    u32 status;
+
+    if (cons_sync_mode) {
+        serial_putc_sync(c);
+        return;
+    }
+
+    status = cons_irq_save();
+    if (txring.wpos - txring.rpos >= TXBUFSIZE) {
+        // 缓冲区满：等发送 FIFO 空出来再搬一批
+        cons_tx_stalls++;
+        while (txring.wpos - txring.rpos >= TXBUFSIZE) {
+            while (!get_UART_THRE(get_UART_LSR()));
+            serial_tx_fill();
+        }
+    }
+    txring.buf[txring.wpos % TXBUFSIZE] = c;
+    txring.wpos++;
+    serial_tx_fill();
+    cons_irq_restore(status);
+}
+
+/**
+ * UART 中断处理，serial_init 注册在 IRQ_UART（Cause.IP3）上，走中断的快速路径
+ * 按 IIR 依次处理：接收数据/超时 -> 读进 cons 缓冲区；THRE -> 继续发送；
+ * 线路状态和 Modem 状态只需读一下对应寄存器来清除
+ * 收到的字符交给行规程（cons_rx）编辑，推迟到 cons_wq 上执行，凑满一行就唤醒读者
+ */
+void serial_irq(void *arg) {
+    u32 iir;
+
+    while (((iir = get_UART_IIR()) & NO_INTPEND) == INTPEND) {
+        switch (iir & (0b111 << 1)) {
+        case RDA:
+        case CT:
+            serial_intr();
+            workq_add(&cons_wq, &cons_rx_work);
+            break;
+        case THRE:
+            serial_tx_fill();
+            break;
+        case RLS:
+            get_UART_LSR();
+            break;
+        default:
+            get_UART_MSR();
+            break;
+        }
+    }
+}
+
+/**
+ * panic 时调用：关掉 UART 中断，把缓冲区里的字符同步发完，
+ * 之后所有输出都直接轮询 THR，不再依赖中断
+ */
+void cons_flush_sync(void) {
+    cons_irq_save();
+    cons_sync_mode = 1;
+    set_UART_IER(0);
+    tx_irq_on = 0;
+    while (txring.rpos != txring.wpos) {
+        serial_putc_sync(txring.buf[txring.rpos % TXBUFSIZE]);
+        txring.rpos++;
+    }
+}
+
 static void serial_init(void) {
     init_uart();
+    irq_register(IRQ_UART, serial_irq, NULL, 0, "uart");
 }
 
 /***** General device-independent console code *****/
@@ -77,10 +209,14 @@ static void cons_intr(int (*proc)(void)) {
  * 4. 如果没有，返回 0
  */
 int cons_getc(void) {
-	int c;
+	int c = 0;
+	u32 status;
+
+	// 接收中断会往 cons 里放字符，这里关中断操作缓冲区
+	status = cons_irq_save();
 
 	// 轮询检查是否有新的输入字符
-	// 这样即使在中断被禁用时（如内核调试器中）也能正常工作
+	// 内核态 EXL=1 时接收中断进不来，这样也能正常工作
 	serial_intr();
 
 	// 从输入缓冲区读取下一个字符
@@ -88,11 +224,11 @@ int cons_getc(void) {
 		// 缓冲区中有未读数据
 		c = cons.buf[cons.rpos % CONSBUFSIZE];
 		cons.rpos++;
-		return c;
 	}
 
-	// 缓冲区为空，没有字符可读
-	return 0;
+	cons_irq_restore(status);
+	// 缓冲区为空时返回 0
+	return c;
 }
 
 /**
@@ -122,8 +258,159 @@ static void cons_putc(int c) {
 	}
 }
 
+/***** 行规程 *****/
+/*
+ * 行编辑（退格、方向键翻历史）和回显由接收中断推迟到 cons_wq 上做：cons_rx 把 cons 里的原始字符
+ * 逐个交给 cons_ldisc，回车时把编辑好的一行放进 cooked，唤醒 cons_readers 上的读者。
+ * 读者（cons_readline）只等整行，在系统调用里阻塞，不再轮询串口。
+ */
+#define LINELEN 1024
+#define HISTNUM 15
+#define COOKEDSIZE (2 * LINELEN)
+
+static char line[LINELEN];          // 正在编辑的一行
+static int line_len;
+static int line_esc;                // 收到过 '['，之后的 A/B 是上下方向键
+static char hist[HISTNUM][LINELEN]; // 0:earliest HISTNUM-1:latest
+static int hist_cur, hist_new, hist_ddl;
+
+// 编辑好、还没被读走的行，每行以 '\0' 结尾
+static struct {
+    char buf[COOKEDSIZE];
+    u32 rpos;
+    u32 wpos;
+    u32 nlines;
+} cooked;
+
+static struct env_waitq cons_readers;
+static u32 cons_lines_dropped; // cooked 放不下、丢掉的行数
+
+// 把历史记录第 hist_cur 条换进正在编辑的行
+static void cons_hist_load(void) {
+    while (line_len > 0) {
+        cputchar('\x7f');
+        line_len--;
+    }
+    while (hist[hist_cur][line_len] >= 32 && line_len < LINELEN - 1) {
+        cputchar(hist[hist_cur][line_len]);
+        line[line_len] = hist[hist_cur][line_len];
+        line_len++;
+    }
+}
+
+// 一行编辑完：记进历史，放进 cooked，唤醒读者
+static void cons_line_done(void) {
+    int i;
+
+    line[line_len] = 0;
+    if (line_len) {
+        memcpy(hist[hist_new], line, LINELEN);
+        hist_new == HISTNUM - 1 ? hist_new = 0 : hist_new++;
+        hist_ddl < HISTNUM - 1 ? hist_ddl++ : hist_ddl;
+        hist_cur = hist_new;
+    }
+    if (COOKEDSIZE - (cooked.wpos - cooked.rpos) > (u32)line_len) {
+        for (i = 0; i <= line_len; i++) {
+            cooked.buf[cooked.wpos % COOKEDSIZE] = line[i];
+            cooked.wpos++;
+        }
+        cooked.nlines++;
+    } else {
+        cons_lines_dropped++;
+    }
+    line_len = 0;
+    line_esc = 0;
+    sched_wake_all(&cons_readers);
+}
+
+static void cons_ldisc(int c) {
+    if (line_esc && c > 64 && c < 69) {
+        if (c == 65) { // 上
+            if (hist_ddl == HISTNUM - 1) {
+                if (!hist_cur)
+                    hist_cur = hist_ddl;
+                else
+                    hist_cur--;
+            } else if (hist_cur) {
+                hist_cur--;
+            }
+            cons_hist_load();
+        } else if (c == 66) { // 下
+            if (hist_cur == HISTNUM - 1)
+                hist_cur = 0;
+            else if (hist_cur < hist_ddl)
+                hist_cur++;
+            cons_hist_load();
+        } else {
+            while (line_len > 0) {
+                cputchar('\x7f');
+                line_len--;
+            }
+        }
+    } else if (c == '\b' || c == '\x7f') {
+        if (line_len > 0) {
+            cputchar('\x7f');
+            line_len--;
+        }
+    } else if (c >= 32 && line_len < LINELEN - 1) {
+        cputchar(c);
+        line[line_len++] = c;
+        if (c == 91)
+            line_esc = 1;
+    } else if (c == '\n' || c == '\r') {
+        cputchar('\n');
+        cons_line_done();
+    }
+}
+
+// 把 cons 里收到的字符都交给行规程；作为推迟的工作执行，或者关着中断调用
+static void cons_rx(void *arg) {
+    int c;
+
+    while (cons.rpos != cons.wpos) {
+        c = cons.buf[cons.rpos % CONSBUFSIZE];
+        cons.rpos++;
+        cons_ldisc(c);
+    }
+}
+
+/**
+ * 读一行编辑好的输入到 ret（最多 len - 1 个字符，以 '\0' 结尾），返回长度。
+ * 还没有整行时，在系统调用里睡在 cons_readers 上，由接收中断唤醒；
+ * 启动阶段还没有进程（curenv 为 NULL），只能轮询串口。
+ */
+int cons_readline(char *ret, int len) {
+    u32 status;
+    int n = 0;
+    char c;
+
+    status = cons_irq_save();
+    serial_intr(); // 内核态 EXL=1 时接收中断进不来，先把 FIFO 里已有的收进来
+    cons_rx(NULL);
+    while (cooked.nlines == 0) {
+        if (curenv != NULL) {
+            sched_wait(&cons_readers);
+        } else {
+            serial_intr();
+            cons_rx(NULL);
+        }
+    }
+    while ((c = cooked.buf[cooked.rpos % COOKEDSIZE]) != 0) {
+        if (n < len - 1)
+            ret[n++] = c;
+        cooked.rpos++;
+    }
+    cooked.rpos++;
+    cooked.nlines--;
+    ret[n] = 0;
+    cons_irq_restore(status);
+    return n;
+}
+
 // initialize the console devices
 void cons_init(void) {
+	TAILQ_INIT(&cons_readers);
+	workq_init(&cons_wq, "cons");
 	serial_init();
 	vga_print_init();
 }
@@ -145,4 +432,8 @@ int getchar(void) {
 int iscons(int fdnum) {
 	// used by readline
 	return 1;
-}
\ No newline at end of file
+}
+
+void cons_print_stat(void) {
+    printf("cons: %d tx stalls, %d input lines dropped\n", cons_tx_stalls, cons_lines_dropped);
+}
@@ -8,7 +8,11 @@ int cons_getc(void);
 void cputchar(int c);
 
 void serial_intr(void);
+void serial_irq(void *arg);
+void cons_flush_sync(void);
+void cons_print_stat(void);
 
 int getchar(void);
+int cons_readline(char *ret, int len);
 
 int iscons(int fdnum);
\ No newline at end of file
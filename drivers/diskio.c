@@ -41,6 +41,9 @@
 #include "sd.h"
 #include <printf.h>
 #include <types.h>
+#include <queue.h>
+#include <string.h>
+#include <workq.h>
 /*--------------------------------------------------------------------------
   Module Private Functions
   ---------------------------------------------------------------------------*/
@@ -323,6 +326,7 @@ DSTATUS disk_initialize (
   // printf("[DISK_INIT]disk init starts ... \n\r", 0);
 
   if (pdrv) return STA_NOINIT;        /* Supports only single drive */
+  if (!(Stat & STA_NOINIT)) disk_cache_sync(); /* Flush before the reset; clean sectors stay cached across f_mount */
   power_off();                        /* Turn off the socket power to reset the card */
   if (Stat & STA_NODISK) return Stat; /* No card in the socket */
   power_on();                         /* Turn on the socket power */
@@ -385,22 +389,19 @@ DSTATUS disk_status (
 
 
 /*-----------------------------------------------------------------------*/
-/* Read Sector(s)                                                        */
+/* Read Sector(s) from the card, bypassing the block cache               */
 /*-----------------------------------------------------------------------*/
 
-DRESULT disk_read (
-                   uint8_t pdrv,          /* Physical drive nmuber (0) */
-                   uint8_t *buff,         /* Pointer to the data buffer to store read data */
-                   uint32_t sector,       /* Start sector number (LBA) */
-                   uint32_t count          /* Sector count (1..128) */
-                   )
+static
+DRESULT sd_read (
+                 uint8_t *buff,         /* Pointer to the data buffer to store read data */
+                 uint32_t sector,       /* Start sector number (LBA) */
+                 uint32_t count          /* Sector count (1..128) */
+                 )
 {
   uint8_t cmd;
 
 
-  if (pdrv || !count) return RES_PARERR;
-  if (Stat & STA_NOINIT) return RES_NOTRDY;
-
   if (!(CardType & CT_BLOCK)) sector *= 512;  /* Convert to byte address if needed */
  
   // printf("[DISK_READ]reading starts at sector %d \n\r", sector);
@@ -425,20 +426,16 @@ DRESULT disk_read (
 
 
 /*-----------------------------------------------------------------------*/
-/* Write Sector(s)                                                       */
+/* Write Sector(s) to the card, bypassing the block cache                */
 /*-----------------------------------------------------------------------*/
 
-#if _USE_WRITE
-DRESULT disk_write (
-                    uint8_t pdrv,          /* Physical drive nmuber (0) */
-                    const uint8_t *buff,   /* Pointer to the data to be written */
-                    uint32_t sector,       /* Start sector number (LBA) */
-                    uint32_t count          /* Sector count (1..128) */
-                    )
+static
+DRESULT sd_write (
+                  const uint8_t *buff,   /* Pointer to the data to be written */
+                  uint32_t sector,       /* Start sector number (LBA) */
+                  uint32_t count          /* Sector count (1..128) */
+                  )
 {
-  if (pdrv || !count) return RES_PARERR;
-  if (Stat & STA_NOINIT) return RES_NOTRDY;
-  if (Stat & STA_PROTECT) return RES_WRPRT;
   // printf("[DISK_WRITE]reading starts at sector = %d \n\r", sector);
 
   if (!(CardType & CT_BLOCK)) sector *= 512;  /* Convert to byte address if needed */
@@ -463,6 +460,287 @@ DRESULT disk_write (
   // printf("[DISK_WRITE]writing is 0-succ/1-fail: %d \n\r", count);
   return count ? RES_ERROR : RES_OK;
 }
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Block cache                                                           */
+/*-----------------------------------------------------------------------*/
+/* Single-sector requests (FAT, directory and FatFs window reads) go     */
+/* through a cache of BCACHE_NBUF sectors kept in LRU order. Writes are  */
+/* held in the cache (write-back) until the sector is evicted or until   */
+/* disk_cache_sync(), which runs on CTRL_SYNC (f_sync/f_close), before   */
+/* the card is re-initialized, and from the deferred work queue once     */
+/* BCACHE_WB_DIRTY sectors are dirty. Multi-sector transfers are bulk    */
+/* file data: they go straight to the card, but are kept coherent with   */
+/* any cached copy of the sectors they cover.                            */
+/* A single-sector miss that continues a sequential stream is turned     */
+/* into one CMD18 burst that also fills the following sectors; the       */
+/* burst doubles on every hit of the stream, up to BCACHE_RA_MAX.        */
+
+#define BCACHE_NBUF   (BCACHE_PAGES * 4096 / 512)
+#define BCACHE_NHASH  64
+#define BCACHE_NSTREAM 4
+#define BCACHE_WB_DIRTY (BCACHE_NBUF / 4)
+
+struct bcache_buf {
+  TAILQ_ENTRY(bcache_buf) lru_link;   /* LRU list, most recent first */
+  LIST_ENTRY(bcache_buf) hash_link;   /* Hash chain by sector */
+  uint32_t sector;
+  uint8_t valid;
+  uint8_t dirty;
+  uint8_t *data;
+};
+
+TAILQ_HEAD(bcache_lru, bcache_buf);
+LIST_HEAD(bcache_chain, bcache_buf);
+
+static uint8_t bcache_data[BCACHE_NBUF * 512] __attribute__((aligned(4)));
+static struct bcache_buf bcache_bufs[BCACHE_NBUF];
+static struct bcache_lru bcache_lru;
+static struct bcache_chain bcache_hash[BCACHE_NHASH];
+static int bcache_ready;
+
+static uint32_t bcache_hits;
+static uint32_t bcache_misses;
+static uint32_t bcache_ndirty;
+
+/* Background write-back, run by workq_run on the way back to user mode */
+static void bcache_wb (void *arg);
+static struct workq bcache_wq;
+static struct work bcache_wb_work = WORK_INIT(bcache_wb, NULL);
+
+/* Sequential streams seen by the read-ahead, replaced round-robin */
+struct bcache_stream {
+  uint32_t next;                      /* Sector expected to miss next */
+  uint32_t window;                    /* Sectors fetched by the last burst */
+};
+
+static struct bcache_stream bcache_streams[BCACHE_NSTREAM];
+static uint32_t bcache_stream_victim;
+static uint8_t bcache_ra_buf[BCACHE_RA_MAX * 512] __attribute__((aligned(4)));
+
+static
+void bcache_init (void)
+{
+  uint32_t i;
+
+  TAILQ_INIT(&bcache_lru);
+  for (i = 0; i < BCACHE_NHASH; i++) LIST_INIT(&bcache_hash[i]);
+  for (i = 0; i < BCACHE_NBUF; i++) {
+    bcache_bufs[i].valid = 0;
+    bcache_bufs[i].dirty = 0;
+    bcache_bufs[i].data = bcache_data + i * 512;
+    TAILQ_INSERT_TAIL(&bcache_lru, &bcache_bufs[i], lru_link);
+  }
+  workq_init(&bcache_wq, "bcache");
+  bcache_ready = 1;
+}
+
+/* Find the cached copy of a sector, or NULL */
+static
+struct bcache_buf *bcache_lookup (uint32_t sector)
+{
+  struct bcache_buf *b;
+
+  LIST_FOREACH(b, &bcache_hash[sector % BCACHE_NHASH], hash_link) {
+    if (b->sector == sector) return b;
+  }
+  return NULL;
+}
+
+/* Mark a buffer most recently used */
+static
+void bcache_touch (struct bcache_buf *b)
+{
+  TAILQ_REMOVE(&bcache_lru, b, lru_link);
+  TAILQ_INSERT_HEAD(&bcache_lru, b, lru_link);
+}
+
+static
+DRESULT bcache_writeback (struct bcache_buf *b)
+{
+  if (!b->dirty) return RES_OK;
+  if (sd_write(b->data, b->sector, 1) != RES_OK) return RES_ERROR;
+  b->dirty = 0;
+  bcache_ndirty--;
+  return RES_OK;
+}
+
+/* Recycle the least recently used buffer for a sector, writing it back first if dirty */
+static
+struct bcache_buf *bcache_get (uint32_t sector)
+{
+  struct bcache_buf *b = TAILQ_LAST(&bcache_lru, bcache_lru);
+
+  if (bcache_writeback(b) != RES_OK) return NULL;
+  if (b->valid) LIST_REMOVE(b, hash_link);
+  b->sector = sector;
+  b->valid = 1;
+  LIST_INSERT_HEAD(&bcache_hash[sector % BCACHE_NHASH], b, hash_link);
+  bcache_touch(b);
+  return b;
+}
+
+/* Number of sectors to fetch for a miss on `sector`: 1 unless it continues a stream */
+static
+uint32_t bcache_ra_window (uint32_t sector)
+{
+  struct bcache_stream *st;
+  uint32_t i;
+
+  for (i = 0; i < BCACHE_NSTREAM; i++) {
+    st = &bcache_streams[i];
+    if (st->window && st->next == sector) {
+      st->window = MIN(st->window * 2, BCACHE_RA_MAX);
+      st->next = sector + st->window;
+      return st->window;
+    }
+  }
+  st = &bcache_streams[bcache_stream_victim++ % BCACHE_NSTREAM];
+  st->next = sector + 1;
+  st->window = 1;
+  return 1;
+}
+
+/* Read `count` sectors in one burst and cache the ones not cached yet */
+static
+DRESULT bcache_fill (uint32_t sector, uint32_t count)
+{
+  struct bcache_buf *b;
+  uint32_t i;
+
+  if (sd_read(bcache_ra_buf, sector, count) != RES_OK) return RES_ERROR;
+  for (i = count; i-- > 0; ) {    /* Backwards, so that `sector` ends up most recently used */
+    if (bcache_lookup(sector + i) != NULL) continue;    /* Keep the cached (maybe dirty) copy */
+    if ((b = bcache_get(sector + i)) == NULL) return RES_ERROR;
+    memcpy(b->data, bcache_ra_buf + i * 512, 512);
+  }
+  return RES_OK;
+}
+
+/* Write every dirty buffer back to the card */
+DRESULT disk_cache_sync (void)
+{
+  struct bcache_buf *b;
+  DRESULT res = RES_OK;
+
+  if (!bcache_ready) return RES_OK;
+  TAILQ_FOREACH(b, &bcache_lru, lru_link) {
+    if (b->valid && bcache_writeback(b) != RES_OK) res = RES_ERROR;
+  }
+  return res;
+}
+
+static
+void bcache_wb (void *arg)
+{
+  disk_cache_sync();
+}
+
+void disk_cache_stat (uint32_t *hits, uint32_t *misses, uint32_t *dirty)
+{
+  *hits = bcache_hits;
+  *misses = bcache_misses;
+  *dirty = bcache_ndirty;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Read Sector(s)                                                        */
+/*-----------------------------------------------------------------------*/
+
+DRESULT disk_read (
+                   uint8_t pdrv,          /* Physical drive nmuber (0) */
+                   uint8_t *buff,         /* Pointer to the data buffer to store read data */
+                   uint32_t sector,       /* Start sector number (LBA) */
+                   uint32_t count          /* Sector count (1..128) */
+                   )
+{
+  struct bcache_buf *b;
+  uint32_t i;
+
+
+  if (pdrv || !count) return RES_PARERR;
+  if (Stat & STA_NOINIT) return RES_NOTRDY;
+  if (!bcache_ready) bcache_init();
+
+  if (count > 1) {            /* Bulk data: read around the cache, then apply cached (possibly dirty) copies */
+    if (sd_read(buff, sector, count) != RES_OK) return RES_ERROR;
+    for (i = 0; i < count; i++) {
+      if ((b = bcache_lookup(sector + i)) != NULL) memcpy(buff + i * 512, b->data, 512);
+    }
+    return RES_OK;
+  }
+
+  if ((b = bcache_lookup(sector)) != NULL) {
+    bcache_hits++;
+  } else {
+    bcache_misses++;
+    i = bcache_ra_window(sector);
+    if (i > 1 && bcache_fill(sector, i) == RES_OK) {
+      b = bcache_lookup(sector);
+    } else {                  /* Not sequential, or the burst failed (e.g. past the end of the card) */
+      if ((b = bcache_get(sector)) == NULL) return RES_ERROR;
+      if (sd_read(b->data, sector, 1) != RES_OK) {
+        LIST_REMOVE(b, hash_link);
+        b->valid = 0;
+        return RES_ERROR;
+      }
+    }
+  }
+  bcache_touch(b);
+  memcpy(buff, b->data, 512);
+  return RES_OK;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Write Sector(s)                                                       */
+/*-----------------------------------------------------------------------*/
+
+#if _USE_WRITE
+DRESULT disk_write (
+                    uint8_t pdrv,          /* Physical drive nmuber (0) */
+                    const uint8_t *buff,   /* Pointer to the data to be written */
+                    uint32_t sector,       /* Start sector number (LBA) */
+                    uint32_t count          /* Sector count (1..128) */
+                    )
+{
+  struct bcache_buf *b;
+  uint32_t i;
+
+
+  if (pdrv || !count) return RES_PARERR;
+  if (Stat & STA_NOINIT) return RES_NOTRDY;
+  if (Stat & STA_PROTECT) return RES_WRPRT;
+  if (!bcache_ready) bcache_init();
+
+  if (count > 1) {            /* Bulk data: write through, and refresh any cached copy */
+    if (sd_write(buff, sector, count) != RES_OK) return RES_ERROR;
+    for (i = 0; i < count; i++) {
+      if ((b = bcache_lookup(sector + i)) != NULL) {
+        memcpy(b->data, buff + i * 512, 512);
+        if (b->dirty) {
+          b->dirty = 0;
+          bcache_ndirty--;
+        }
+      }
+    }
+    return RES_OK;
+  }
+
+  if ((b = bcache_lookup(sector)) == NULL && (b = bcache_get(sector)) == NULL) return RES_ERROR;
+  bcache_touch(b);
+  memcpy(b->data, buff, 512);
+  if (!b->dirty) {
+    b->dirty = 1;
+    if (++bcache_ndirty >= BCACHE_WB_DIRTY) workq_add(&bcache_wq, &bcache_wb_work);
+  }
+  return RES_OK;
+}
 #endif
 
 
@@ -490,7 +768,7 @@ DRESULT disk_ioctl (
 
   switch (cmd) {
   case CTRL_SYNC :        /* Make sure that no pending write process. Do not remove this or written sector might not left updated. */
-    if (select()) res = RES_OK;
+    if (disk_cache_sync() == RES_OK && select()) res = RES_OK;
     break;
 
   case GET_SECTOR_COUNT : /* Get number of sectors on the disk (uint32_t) */
@@ -564,6 +842,7 @@ DRESULT disk_ioctl (
     break;
 
   case CTRL_POWER_OFF :   /* Power off */
+    disk_cache_sync();
     power_off();
     Stat |= STA_NOINIT;
     res = RES_OK;
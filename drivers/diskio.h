@@ -48,6 +48,8 @@ extern "C" {
 
 #define _USE_WRITE  1   /* 1: Enable disk_write function */
 #define _USE_IOCTL  1   /* 1: Enable disk_ioctl fucntion */
+#define BCACHE_PAGES 8  /* Block cache size in 4KB pages (8 sectors each) */
+#define BCACHE_RA_MAX 16 /* Largest read-ahead burst in sectors (at most half the cache) */
 
   /* Status of Disk Functions */
   typedef uint8_t    DSTATUS;
@@ -76,6 +78,8 @@ extern "C" {
   DRESULT disk_ioctl (uint8_t pdrv, uint8_t cmd, void* buff);
 #endif
   void disk_timerproc (void);
+  DRESULT disk_cache_sync (void);
+  void disk_cache_stat (uint32_t *hits, uint32_t *misses, uint32_t *dirty);
 
 
   /* Disk Status Bits (DSTATUS) */
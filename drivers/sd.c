@@ -3,11 +3,17 @@
 #include "sd.h"
 #include "..\inc\types.h"
 #include "..\inc\printf.h"
+#include <irq.h>
 
 #define GetBit(r, p) (((r) & (1 <<p)) >> p)
 
 volatile uint32_t *spi_base_ptr = (uint32_t *)(SPI_BASE);
 
+// SPI 中断：ISR 写 1 清除，读出来原样写回去就把挂起的位都清掉了；次数记在 irq_table 里
+static void spi_irq(void *arg) {
+  *(spi_base_ptr + SPI_ISR) = *(spi_base_ptr + SPI_ISR);
+}
+
 void spi_init() {
   uint32_t resp;
 
@@ -22,7 +28,9 @@ void spi_init() {
   *(spi_base_ptr + SPI_CR) = 0xE4;
   
   // disable interrupt, full polling mode
+  // the handler is registered anyway, so enabling GIER later only needs the IER bits
   *(spi_base_ptr + SPI_GIER) = 0x0;
+  irq_register(IRQ_SPI, spi_irq, NULL, 0, "spi");
 
   // read status register
   resp = (*(spi_base_ptr + SPI_SR)) & 0x7FF;
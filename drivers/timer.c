@@ -3,6 +3,8 @@
 #include <mips/cpu.h>
 #include <mfp_io.h>
 #include <printf.h>
+#include <irq.h>
+#include <sched.h>
 #include "seven_seg.h"
 
 #define AXI_CLOCK_PERIOD_HZ     50000000
@@ -61,16 +63,23 @@ void set_timing_interval_ms(u32 ms) {
     set_TLR0(ms * AXI_CLOCK_PERIOD_KHZ - 4);
 }
 
+// 时钟中断：清掉中断标志，交给调度器记一个 tick，不返回
+static void timer_irq(void *arg) {
+    clear_timer0_int();
+    sched_tick();
+}
+
 extern void set_exl();
-void init_timer() {
+void init_timer(u32 ms) {
     set_TCSR0(0);
     set_exl();
     // set_timing_interval_s(1);
-    set_timing_interval_ms(1000);//中断时间
+    set_timing_interval_ms(ms);//中断时间，即调度器的 tick
     set_TCSR0(
         TIMER_TCSR0_ENIT0 |
         TIMER_TCSR0_ARHT0 |
         TIMER_TCSR0_UDT0
     );
+    irq_register(IRQ_TIMER, timer_irq, NULL, IRQF_RESCHED, "timer");
     enable_timer0();
 }
\ No newline at end of file
@@ -16,4 +16,4 @@ void disable_timer0();
 void set_timing_interval_s(u32 s);
 void set_timing_interval_ms(u32 ms);
 
-void init_timer();
\ No newline at end of file
+void init_timer(u32 ms);
\ No newline at end of file
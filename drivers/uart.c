@@ -56,6 +56,6 @@ void init_uart() {
     set_UART_DLL(27); // DLL msb. 115200 at 50MHz. Formula is Clk/16/baudrate. From axi_uart manual.
     set_UART_DLM(0); // DLL lsb.
     set_UART_LCR(BITS_8_PER_CHAR | STOP_BITS_1); // LCR register. 8n1 parity disabled
-    // set_UART_IER(ERBFI); // Enable Interrupts
-    set_UART_IER(0); // Disable Interrupts
+    set_UART_FCR(FIFO_ENABLE | RX_FIFO_RESET | TX_FIFO_RESET | RX_TRIGGER_1); // 16550 mode, FIFOs cleared
+    set_UART_IER(ERBFI); // 接收中断常开；发送中断（ETBEI）由 console.c 在发送缓冲区非空时打开
 }
@@ -22,6 +22,14 @@
 #define INTPEND    (0 << 0) // Interrupt Pending : 0 - Interrupt is pending,
 #define NO_INTPEND (1 << 0) // 1 - No interrupt is pending.
 
+// FIFO Control Register Bit Definitions
+#define FIFO_ENABLE   (1 << 0) // Enable RCVR and XMIT FIFOs.
+#define RX_FIFO_RESET (1 << 1) // Clear all bytes in the RCVR FIFO.
+#define TX_FIFO_RESET (1 << 2) // Clear all bytes in the XMIT FIFO.
+#define RX_TRIGGER_1  (0b00 << 6) // RCVR FIFO interrupt trigger level: 1 byte.
+
+#define UART_FIFO_DEPTH 16 // THRE 中断到来时 XMIT FIFO 为空，最多可连续写入的字节数
+
 // Line Control Register Bit Definitions
 #define DLAB            (1 << 7) // Divisor Latch Access Bit.
 #define SET_BREAK       (1 << 6) // Set Break.
@@ -2,7 +2,7 @@
  env.c 文件是操作系统内核中负责进程管理的核心模块。它实现了进程的创建（env_alloc, load_icode, env_create_*）、
  初始化（env_init, env_setup_vm）、查找（envid2env）、ID生成（mkenvid）、销毁（env_free）以及调度运行（env_run）等功能。
  它与内存管理（pmap.h）、文件系统（ff.h）、ELF解析（elf.h）和底层硬件（通过汇编函数 lcontext, env_pop_tf, set_asid）紧密交互。
- pthread_create 和 copy_curenv 表明系统还尝试支持某种形式的线程或轻量级进程。
+ 线程（thread_create）与所属进程共用页目录和 ASID，只有现场和用户栈是自己的。
  */
 #include <stdint.h>
 #include <mmu.h>
@@ -12,6 +12,7 @@
 #include <sched.h>
 #include <pmap.h>
 #include <printf.h>
+#include <log.h>
 #include <../fs/ff.h>
 #include <../fs/elf.h>
 #include <../drivers/timer.h>
@@ -22,7 +23,7 @@ envs: 指向所有环境（进程）控制块（Env 结构体数组）的指针
 curenv: 指向当前正在运行的环境（进程）的指针。
 mCONTEXT, curtf: 外部变量，可能用于保存当前的页表基址和上下文信息，供汇编代码使用。
 env_free_list: 空闲环境控制块的链表头指针。未使用的 Env 结构体会链接在这里。
-env_runnable_head, env_runnable_tail: 可运行环境（进程）的循环链表的头和尾指针。处于 ENV_RUNNABLE 状态的进程会被放入这个队列等待调度。
+可运行的进程放在 sched.c 按优先级维护的运行队列里（sched_insert / sched_remove）。
 */
 struct Env *envs = NULL;   // All environments
 struct Env *curenv = NULL; // the current env
@@ -30,38 +31,28 @@ extern int mCONTEXT;
 extern int curtf;
 struct Env *env_free_list = NULL; // Free list
 
-struct Env *env_runnable_head = NULL; // Runnable ring head
-struct Env *env_runnable_tail = NULL; // Runnable ring tail
 extern Pde *boot_pgdir;				  // kernel page directory
-extern char *KERNEL_SP;				  // top of kernel stack
-extern int remaining_time;			  // remaining time for current env
+extern char *KERNEL_SP;				  // top of curenv's kernel stack, see env_run
 
 /*
 声明外部变量和函数。
 boot_pgdir: 内核启动时使用的页目录。
-KERNEL_SP: 内核栈指针。
-remaining_time: 可能与进程时间片有关。
+KERNEL_SP: 当前进程的内核栈顶，异常入口（SAVE_ALL/SAVE_TF）切到这里。
 env_pop_tf: 汇编函数，用于恢复陷阱帧（Trapframe）并跳转到用户模式执行。
 lcontext: 汇编函数，用于切换地址空间（通常是加载新的页表基址到MMU）。
 set_asid, get_asid: 设置/获取当前活动的地址空间标识符（ASID）。这在支持TLB的处理器中很重要，用于区分不同进程的TLB条目。
 set_epc: 设置CP0 EPC寄存器（异常程序计数器）。
-create_share_vm, insert_share_vm: 创建和插入共享内存页面的函数。
 get_status: 获取CPU状态寄存器。
-copy_curenv: 复制当前环境以创建新线程的函数。
 */
 extern Pde *boot_pgdir;
 extern char *KERNEL_SP;
-extern int remaining_time;
 
 extern void env_pop_tf(struct Trapframe *tf);
 extern void lcontext(uint32_t contxt, int n);
 extern void set_asid(uint32_t id);
 extern u32 get_asid(void);
 extern void set_epc(uint32_t epc);
-extern struct Page *create_share_vm(int key, size_t size);
-extern void *insert_share_vm(struct Env *e, struct Page *p);
 extern u32 get_status();
-extern void copy_curenv(struct Env *e, struct Env *env_src, void *func, int arg);
 /*
 申请一个envid, 低位为 e 在 envs 中的位置，高位为自增编号
  */
@@ -77,6 +68,66 @@ u_int mkenvid(struct Env *e)
 	return (next_env_id << (1 + LOG2NENV)) | low;
 }
 
+/*
+ASID 分配：env_asid 的低 8 位是硬件 ASID，高位是发放它时的代数 asid_generation。
+每一代从 1 开始依次发放（0 留给内核，没有进程时用），256 个发完就把整个 TLB 清一次，
+代数加一，所有进程手里的 ASID 随之作废，等下次被调度时再领新的。
+同一代里 ASID 不会重复发放，所以切换进程时不用清 TLB，进程数也不受 256 的限制。
+ASID 属于地址空间：同一进程的线程用的都是 env_proc 上的那一个。
+ */
+static u_int asid_generation = NASID; // 第一代，低 8 位恒为 0
+static u_int asid_next = 1;
+u_int asid_rollovers; // 换代（清空整个 TLB）的次数
+
+static void asid_new_generation(void)
+{
+	tlb_flush_all();
+	asid_generation += NASID;
+	if (asid_generation == 0)
+	{ // 代数回绕，跳过 0，env_asid 为 0 表示从没分配过
+		asid_generation = NASID;
+	}
+	asid_next = 1;
+	asid_rollovers++;
+	kdebug(ENV, "asid: new generation 0x%x\n", asid_generation);
+}
+
+// 返回 e 在当前这一代里的硬件 ASID，过期或从没分配过就重新领一个
+u_int env_get_asid(struct Env *e)
+{
+	e = e->env_proc;
+	if ((e->env_asid & ~ASID_MASK) != asid_generation)
+	{
+		if (asid_next == NASID)
+		{
+			asid_new_generation();
+			// curenv 正在用的 ASID 也作废了，马上给它换一个，免得和接下来发出去的撞上
+			if (curenv != NULL && curenv->env_proc != e)
+			{
+				curenv->env_proc->env_asid = asid_generation | asid_next++;
+			}
+		}
+		e->env_asid = asid_generation | asid_next++;
+	}
+	return e->env_asid & ASID_MASK;
+}
+
+// e 手里的 ASID 是否属于当前这一代；不是的话 TLB 里不可能还有它的项
+int env_asid_live(struct Env *e)
+{
+	e = e->env_proc;
+	return e->env_asid != 0 && (e->env_asid & ~ASID_MASK) == asid_generation;
+}
+
+/*
+整体作废 e 的 ASID：同一代里 ASID 不会重复发放，换代时又会清空整个 TLB，
+所以 TLB 里残留的这个 ASID 的项再也不会命中，不用逐页去清。
+ */
+void env_retire_asid(struct Env *e)
+{
+	e->env_proc->env_asid = 0;
+}
+
 // 根据环境ID (envid) 查找对应的 Env 结构体指针
 /* Overview:
  *  Converts an envid to an env pointer.
@@ -101,7 +152,7 @@ int envid2env(u_int envid, struct Env **penv, int checkperm)
 		*penv = curenv;
 		return 0;
 	}
-	e = envs + GET_ENV_ASID(envid);
+	e = envs + ENVX(envid);
 	if (e->env_status == ENV_FREE || e->env_id != envid) // ENV_FREE表示进程列表的这个位置是空的
 	{
 		// 空闲或 id 不匹配则失败
@@ -142,7 +193,6 @@ int envid2env(u_int envid, struct Env **penv, int checkperm)
 将每个 Env 结构体的 env_id 初始化为无效值 0xFFFFFFFF。
 将 env_status 设置为 ENV_FREE，表示初始时所有环境都是空闲的。
 将每个 Env 结构体通过其 env_link 指针链接到 env_free_list 链表上，形成一个空闲池。注意是从后往前插入，所以最后 envs[0] 会在链表头。
-heap_pc 初始化为 UTOP，表示用户堆尚未分配任何空间。
 */
 void env_init(void)
 {
@@ -156,8 +206,8 @@ void env_init(void)
 		// 插入到 env_free_list 链表头节点
 		envs[i].env_link = env_free_list;
 		env_free_list = &envs[i];
-		envs[i].heap_pc = UTOP;
 	}
+	sched_init();
 }
 
 // 初始化 e 的虚拟地址空间
@@ -182,7 +232,8 @@ static int env_setup_vm(struct Env *e)
 	/*Step 1: Allocate a page for the page directory using a function you completed in the lab2.
 	 * and add its reference.
 	 *pgdir is the page directory of Env e, assign value for it. */
-	if ((r = page_alloc(&p)) < 0)
+	// 下面会写满整个页目录，不需要先清零
+	if ((r = page_alloc_nozero(&p)) < 0)
 	{ /* Todo here*/
 		panic("env_setup_vm - page alloc error\n");
 		return r;
@@ -192,9 +243,9 @@ static int env_setup_vm(struct Env *e)
 	e->env_pgdir = pgdir;
 	e->env_cr3 = page2pa(p);
 
-	/*Step 2: Zero pgdir's field before UTOP. */
-	// UTOP 以下清零，以上拷贝内核映射
-	for (i = 0; i < PDX(UTOP); i++)
+	/*Step 2: Zero pgdir's field before USHMTOP. */
+	// USHMTOP 以下清零（包括共享内存窗口），以上拷贝内核映射
+	for (i = 0; i < PDX(USHMTOP); i++)
 	{
 		pgdir[i] = 0;
 	}
@@ -210,6 +261,26 @@ static int env_setup_vm(struct Env *e)
 	return 0;
 }
 
+/*
+e 还没有内核栈就分配一个。栈跟着控制块走，env_free 时不还：
+env_free(curenv) 自己就跑在这个栈上，控制块下次被复用时接着用。
+ */
+static int env_kstack_alloc(struct Env *e)
+{
+	struct Page *pp;
+
+	if (e->env_kstack == 0)
+	{
+		if (page_alloc_order_nozero(&pp, ENV_KSTKORDER) < 0) // 栈上的东西都是先写后读，不用清零
+		{
+			return -E_NO_MEM;
+		}
+		e->env_kstack = page2kva(pp);
+	}
+	e->env_ksp = 0;
+	return 0;
+}
+
 /* Overview:
  *  Allocates and Initializes a new environment.
  *  On success, the new environment is stored in *new.
@@ -249,6 +320,10 @@ int env_alloc(struct Env **new, u_int parent_id)
 	{
 		return -E_NO_FREE_ENV;
 	}
+	if ((r = env_kstack_alloc(e)) < 0)
+	{
+		return r;
+	}
 
 	/*Step 2: Call certain function(has been implemented) to init kernel memory layout for this new Env.
 	 *The function mainly maps the kernel address to this new Env address. */
@@ -270,6 +345,14 @@ int env_alloc(struct Env **new, u_int parent_id)
 	e->env_tf.regs[29] = USTACKTOP;	 // 栈顶
 	e->env_tf.regs[31] = 0x90000000; // 返回地址（指向结束的系统调用）
 	e->env_runs = 0;
+	sched_env_init(e);
+	e->env_asid = 0;
+	bzero(&e->env_vm, sizeof(e->env_vm));
+	LIST_INIT(&e->env_shm);
+	e->env_proc = e;
+	LIST_INIT(&e->env_threads);
+	e->env_tstacks = 0;
+	e->env_tslot = -1;
 
 	/*Step 5: Remove the new Env from Env free list*/
 	env_free_list = env_free_list->env_link;
@@ -289,6 +372,11 @@ int env_alloc_arg(struct Env **new, u_int parent_id, char *arg)
 		*new = NULL;
 		return -E_NO_FREE_ENV;
 	}
+	if ((r = env_kstack_alloc(e)) < 0)
+	{
+		*new = NULL;
+		return r;
+	}
 	/*Step 2: Call certain function(has been implemented) to init kernel memory layout for this new Env.
 	 *The function mainly maps the kernel address to this new Env address. */
 	if ((r = env_setup_vm(e)) < 0)
@@ -308,6 +396,14 @@ int env_alloc_arg(struct Env **new, u_int parent_id, char *arg)
 	e->env_tf.regs[29] = USTACKTOP;	 // 栈顶
 	e->env_tf.regs[31] = 0x90000000; // 返回地址（指向结束的系统调用处理函数）
 	e->env_runs = 0;
+	sched_env_init(e);
+	e->env_asid = 0;
+	bzero(&e->env_vm, sizeof(e->env_vm));
+	LIST_INIT(&e->env_shm);
+	e->env_proc = e;
+	LIST_INIT(&e->env_threads);
+	e->env_tstacks = 0;
+	e->env_tslot = -1;
 	*new = e;
 
 	/*Step 5: Remove the new Env from Env free list*/
@@ -326,26 +422,164 @@ int env_alloc_arg(struct Env **new, u_int parent_id, char *arg)
 /*
 定义与文件系统和内存相关的常量及辅助函数。
 FatFs: FatFs文件系统的根对象。
-MAX_FILE_SIZE: 单个文件的最大大小（16MB）。
-DDR_SIZE: DDR内存总大小（256MB）。
-SD_READ_SIZE: 从SD卡读取数据的块大小（4KB）。
-get_ddr_base(): 获取DDR内存基地址（0x80000000）
+ELF_MAX_PHDR: 直接从文件加载时最多支持的 Program Header 个数。
 */
 FATFS FatFs; // Work area (file system object) for logical drive
 
-// max size of file image is 16M
-#define MAX_FILE_SIZE 0x1000000
+// program headers read onto the kernel stack by load_elf_stream
+#define ELF_MAX_PHDR 16
+
+/* Overview:
+ *  Load a statically linked ELF from `fil` straight into the pages of `e`.
+ *  The ELF header and program headers are read first. Each PT_LOAD segment is
+ *  then read with f_lseek/f_read, page by page, into pages allocated and
+ *  mapped in `e` with page_insert. The pages are written through kseg0, so
+ *  there is no staging copy and no TLB miss per page. page_alloc hands out
+ *  pre-zeroed pages, so BSS and the ends of partial pages are already zero.
+ *
+ * Post-Condition:
+ *  Return 0 and set *entry on success.
+ *  Return 1 if the ELF needs dynamic linking (the caller uses load_elf_sd).
+ *  Return -1 on a damaged file, a read error or out of memory.
+ */
+static int load_elf_stream(FIL *fil, struct Env *e, uint32_t *entry)
+{
+	Elf32_Ehdr eh;
+	Elf32_Phdr ph[ELF_MAX_PHDR];
+	struct Page *p;
+	Pte *pte;
+	uint32_t br, i, va, start, end, seg_end;
+
+	if (f_read(fil, &eh, sizeof(eh), &br) || br != sizeof(eh) || !IS_ELF32(eh))
+	{
+		kerr(ENV, "Not a valid ELF32 file\n");
+		return -1;
+	}
+	if (eh.e_phnum > ELF_MAX_PHDR)
+	{
+		kerr(ENV, "Too many program headers: %d\n", eh.e_phnum);
+		return -1;
+	}
+	if (f_lseek(fil, eh.e_phoff) || f_read(fil, ph, eh.e_phnum * sizeof(Elf32_Phdr), &br) ||
+		br != eh.e_phnum * sizeof(Elf32_Phdr))
+	{
+		kerr(ENV, "ELF file internal damaged\n");
+		return -1;
+	}
+
+	for (i = 0; i < eh.e_phnum; i++)
+	{
+		if (ph[i].p_type == PT_DYNAMIC || ph[i].p_type == PT_INTERP)
+		{
+			return 1;
+		}
+	}
+
+	for (i = 0; i < eh.e_phnum; i++)
+	{
+		if (ph[i].p_type != PT_LOAD || ph[i].p_memsz == 0)
+		{
+			continue;
+		}
+		seg_end = ph[i].p_vaddr + ph[i].p_memsz;
+		if (ph[i].p_filesz > ph[i].p_memsz || seg_end < ph[i].p_vaddr || seg_end > UTOP)
+		{
+			kerr(ENV, "Bad segment at 0x%x\n", ph[i].p_vaddr);
+			return -1;
+		}
+
+		for (va = ROUNDDOWN(ph[i].p_vaddr, BY2PG); va < seg_end; va += BY2PG)
+		{
+			// 相邻两个段可能落在同一页
+			p = page_lookup(e->env_pgdir, va, &pte);
+			if (p == NULL)
+			{
+				if (page_alloc(&p) < 0 || page_insert(e->env_pgdir, p, va, PTE_V | PTE_R) < 0)
+				{
+					kerr(ENV, "load_elf_stream: out of memory\n");
+					return -1;
+				}
+			}
 
-// size of DDR RAM (256M for Minisys)
-#define DDR_SIZE 0x10000000
+			// 本页中来自文件的部分 [start, end)，其余部分保持为 0
+			start = MAX(va, ph[i].p_vaddr);
+			end = MIN(va + BY2PG, ph[i].p_vaddr + ph[i].p_filesz);
+			if (start >= end)
+			{
+				continue;
+			}
+			if (f_lseek(fil, ph[i].p_offset + (start - ph[i].p_vaddr)) ||
+				f_read(fil, (void *)(page2kva(p) + (start - va)), end - start, &br) || br != end - start)
+			{
+				kerr(ENV, "Segment exceeds file size\n");
+				return -1;
+			}
+		}
+	}
 
-// 4K size read burst
-#define SD_READ_SIZE 4096
+	*entry = eh.e_entry;
+	return 0;
+}
 
-// 得到我们添加的 DDR3SDRAM 的基址，load elf 时, 貌似是放到 DDR 最末端
-uint32_t get_ddr_base()
+/* Overview:
+ *  Dynamically linked ELFs still go through load_elf_sd, which needs the whole
+ *  file in memory. Read it into a block of contiguous pages borrowed from the
+ *  buddy allocator, load it with `e`'s address space active, then give the
+ *  block back. Return the entry point, or 1 on failure.
+ */
+static uint32_t load_elf_staged(FIL *fil, struct Env *e)
 {
-	return 0x80000000;
+	struct Page *buf_page;
+	uint8_t *boot_file_buf;
+	uint32_t fsize = f_size(fil);
+	uint32_t entry_point = 1;
+	uint32_t br;
+	u_int order = 0;
+
+	while ((BY2PG << order) < fsize)
+	{
+		order++;
+	}
+	// 前 fsize 字节马上被文件内容盖掉，后面的没人读，不用清零
+	if (order > PAGE_MAX_ORDER || page_alloc_order_nozero(&buf_page, order) < 0)
+	{
+		kerr(ENV, "No room to stage %d bytes of ELF\n", fsize);
+		return 1;
+	}
+	boot_file_buf = (uint8_t *)page2kva(buf_page);
+
+	if (f_lseek(fil, 0) || f_read(fil, boot_file_buf, fsize, &br) || br != fsize)
+	{
+		kerr(ENV, "Failed to read ELF file\n");
+		page_free_order(buf_page, order);
+		return 1;
+	}
+	kdebug(ENV, "Load %d bytes to memory address %x \n\r", fsize, (uint32_t)boot_file_buf);
+	kdebug(ENV, "BeforeLOAD:  Mcontext : 0x%x  ASID: 0x%x\n", mCONTEXT, get_asid());
+	// 保存当前环境
+	int pre_pgdir = mCONTEXT;
+	int pre_curtf = curtf;
+
+	// 加载 elf 进内存时会触发缺页中断，缺页中断会填当前调用进程的 asid 和页表基址进 tlb 页表项
+	lcontext(e->env_pgdir, 0); // 因此，上下文切换到要新建的进程的 asid，之后缺页中断会填这个进程的 tlb
+	set_asid(env_get_asid(e));
+
+	// read elf
+	if (load_elf_sd(boot_file_buf, fsize) != 0)
+	{
+		kerr(ENV, "elf read failed\n\r");
+	}
+	else
+	{
+		entry_point = get_entry(boot_file_buf, fsize);
+	}
+
+	// 这里和上面是一对的
+	lcontext(pre_pgdir, pre_curtf);	  // context 换回来
+	set_asid(curenv ? env_get_asid(curenv) : 0); // asid 换回来
+
+	page_free_order(buf_page, order);
+	return entry_point;
 }
 
 // 从文件系统中读取elf_name，加载到指定环境的内存中
@@ -356,85 +590,54 @@ e: 目标环境。
 功能：
 使用FatFs挂载SD卡。
 打开名为 elf_name 的文件。
-将文件内容读入到DDR内存末尾预留的大缓冲区 boot_file_buf 中。
-关键部分：为了使ELF加载过程中产生的缺页中断能够正确地更新目标环境 e 的TLB（Translation Lookaside Buffer），需要临时切换当前的地址空间上下文 (lcontext) 和ASID (set_asid) 到环境 e。
-调用 load_elf_sd 解析 boot_file_buf 中的ELF数据，并根据ELF头部信息将其各段（代码、数据）加载到环境 e 的虚拟地址空间中（这个过程会触发缺页中断，由内核处理并建立正确的页表映射）。
-调用 get_entry 获取ELF文件的入口点地址。
-恢复之前的地址空间上下文和ASID。
+静态链接的 ELF 由 load_elf_stream 逐段直接读进 e 的物理页，不经过中转缓冲区。
+动态链接的 ELF 仍按原方式处理：
+  从 buddy 分配器借一块连续物理页作为中转缓冲区，把整个文件读进来；
+  为了使ELF加载过程中产生的缺页中断能够正确地更新目标环境 e 的TLB（Translation Lookaside Buffer），需要临时切换当前的地址空间上下文 (lcontext) 和ASID (set_asid) 到环境 e；
+  调用 load_elf_sd 解析并加载各段、完成动态链接，再恢复之前的地址空间上下文和ASID，归还中转缓冲区。
 关闭文件。
-返回ELF的入口点地址。
+返回ELF的入口点地址（失败返回 1）。
 */
 uint32_t load_elf_mapper(char *elf_name, struct Env *e)
 {
 	FIL fil;	// File object
 	FRESULT fr; // FatFs return code
-
-	uint8_t *boot_file_buf = (uint8_t *)(get_ddr_base()) + DDR_SIZE - MAX_FILE_SIZE; // at the end of DDR space
+	uint32_t entry_point = 1;
+	int r;
 
 	// Register work area to the default drive
 	if (f_mount(&FatFs, "", 1))
 	{
-		printf("Fail to mount SD driver!\n\r", 0);
+		kerr(ENV, "Fail to mount SD driver!\n\r", 0);
 		return 1;
 	}
 
 	// Open a file
-	printf("Loading %s into memory...\n\r", elf_name);
+	kinfo(ENV, "Loading %s into memory...\n\r", elf_name);
 	fr = f_open(&fil, elf_name, FA_READ);
 	if (fr)
 	{
-		printf("Failed to open %s!\n\r", elf_name);
+		kerr(ENV, "Failed to open %s!\n\r", elf_name);
 		// return (int)fr;
 		return 1;
 	}
 
-	// Read file into memory
-	uint8_t *buf = boot_file_buf; // boot_file_buf 是个固定值
-	uint32_t fsize = 0;			  // file size count
-	uint32_t br;				  // Read count
-	// 以下就是指导手册 61 页，boot loader 中 load elf 的前置代码
-	do
+	r = load_elf_stream(&fil, e, &entry_point);
+	if (r == 1)
 	{
-		if (fsize % 1024 == 0)
-		{
-			printf("Loading %d KB to memory address \r", fsize / 1024);
-		}
-		// Read a chunk of source file
-		fr = f_read(&fil, buf, SD_READ_SIZE, &br);
-		fsize += br;
-		buf += br;
-
-	} while (!(fr || br == 0));
-
-	printf("Load %d bytes to memory address ", fsize);
-	printf("%x \n\r", (uint32_t)boot_file_buf);
-	printf("BeforeLOAD:  Mcontext : 0x%x  ASID: 0x%x\n", mCONTEXT, get_asid());
-	// 保存当前环境
-	int pre_pgdir = mCONTEXT;
-	int pre_curtf = curtf;
-	int pre_asid = curenv->env_id;
-
-	// 加载 elf 进内存时会触发缺页中断，缺页中断会填当前调用进程的 asid 和页表基址进 tlb 页表项
-	lcontext(e->env_pgdir, 0); // 因此，上下文切换到要新建的进程的 asid，之后缺页中断会填这个进程的 tlb
-	set_asid(GET_ENV_ASID(e->env_id));
-
-	// read elf
-	if (load_elf_sd(boot_file_buf, fsize) != 0)
-		if (br = load_elf_sd(boot_file_buf, fil.fsize))
-			printf("elf read failed with code %d \n\r", br);
-
-	uint32_t entry_point = get_entry(boot_file_buf, fil.fsize);
-
-	// 这里和上面是一对的
-	lcontext(pre_pgdir, pre_curtf);	  // context 换回来
-	set_asid(GET_ENV_ASID(pre_asid)); // sid 换回来
+		entry_point = load_elf_staged(&fil, e);
+	}
+	else if (r < 0)
+	{
+		entry_point = 1;
+	}
 
-	printf("\nfinish load elf!\n");
+	kinfo(ENV, "\nfinish load elf!\n");
 
 	// Close the file
 	if (f_close(&fil))
 	{
-		printf("fail to close file!\n\r", 0);
+		kerr(ENV, "fail to close file!\n\r", 0);
 	}
 
 	return entry_point;
@@ -471,7 +674,7 @@ load_icode(struct Env *e, char *elf_name)
 	p->pp_ref++;
 	if (r < 0)
 	{
-		printf("ERROR in load_icode:page_alloc failed\n");
+		kerr(ENV, "ERROR in load_icode:page_alloc failed\n");
 		return;
 	}
 
@@ -481,14 +684,14 @@ load_icode(struct Env *e, char *elf_name)
 	r = page_insert(e->env_pgdir, p, USTACKTOP - BY2PG, perm); // USTACKTOP向下增长一页的大小
 	if (r < 0)
 	{
-		printf("error,load_icode:page_insert failed\n");
+		kerr(ENV, "error,load_icode:page_insert failed\n");
 		return;
 	}
 
-	printf("load_elf:%s\n", elf_name);
+	kinfo(ENV, "load_elf:%s\n", elf_name);
 	entry_point = load_elf_mapper(elf_name, e); // 将完整的二进制镜像 (elf) 加载到进程的用户内存中去
-	// 目前, 设计上会需要将完整的 elf 通过文件系统读到内存中一个固定地址（boot_file_buf 是个固定值），
-	// 然后根据这部分内存的内容，读出 elf 的管理信息，再将实际的代码存到 elf 指定的进程虚拟地址空间中去。
+	// 静态链接的 elf 先读 elf 头和 program header，再把各段直接从文件读进进程的物理页；
+	// 动态链接的 elf 才需要把整个文件读进中转缓冲区，由 load_elf_sd 加载并完成链接。
 	assert(entry_point != 1); // load 失败
 
 	e->env_tf.cp0_epc = entry_point; // 将 elf 指定的的代码入口地址 entry_point,
@@ -519,7 +722,7 @@ load_icode(struct Env *e, char *elf_name)
 // 创建一个具有指定优先级的新环境（进程）
 void env_create_priority(char *binary, int priority)
 {
-	struct Env *e, *tmp;
+	struct Env *e;
 	int r;
 	extern void debug();
 	/*Step 1: Use env_alloc to alloc a new env. */
@@ -534,35 +737,17 @@ void env_create_priority(char *binary, int priority)
 	e->env_pri = priority;
 
 	/*Step 3: Use load_icode() to load the named elf binary. */
-	printf("load_icode:%s\n", binary);
+	kinfo(ENV, "load_icode:%s\n", binary);
 	load_icode(e, binary);
 
-	/* Step 4 (additional): 将 env 加到 env_runnable 链表里*/
-	if (env_runnable_head == NULL)
-	{ // env_runnable 链表是否为空
-		e->env_link = e;
-		env_runnable_head = env_runnable_tail = e;
-	}
-	else
-	{
-		e->env_link = env_runnable_head;
-		env_runnable_tail->env_link = e;
-		env_runnable_tail = e;
-	}
-	// 调试：遍历输出 env_runnable 链表
-	tmp = env_runnable_head;
-	printf("list ID: 0x%x \n", env_runnable_head->env_id);
-	while (tmp != env_runnable_tail)
-	{
-		printf(" 0x%x ", tmp->env_id);
-		tmp = tmp->env_link;
-	}
-	printf("\ntail ID: 0x%x \n", env_runnable_tail->env_id);
+	/* Step 4 (additional): 将 env 加到对应优先级的运行队列里*/
+	sched_insert(e);
+	kinfo(ENV, "env ID: 0x%x -> run queue %d\n", e->env_id, e->env_pri);
 }
 // 参数化创建一个具有指定优先级的新环境（进程）
 void env_create_priority_arg(char *binary, int priority, char *arg)
 {
-	struct Env *e, *tmp;
+	struct Env *e;
 	int r;
 	extern void debug();
 	/*Step 1: Use env_alloc to alloc a new env. */
@@ -576,30 +761,12 @@ void env_create_priority_arg(char *binary, int priority, char *arg)
 	e->env_pri = priority;
 
 	/*Step 3: Use load_icode() to load the named elf binary. */
-	printf("load_icode:%s\n", binary);
+	kinfo(ENV, "load_icode:%s\n", binary);
 	load_icode(e, binary);
 
-	/* Step 4 (additional): 将 env 加到 env_runnable 链表里*/
-	if (env_runnable_head == NULL)
-	{ // env_runnable 链表是否为空
-		e->env_link = e;
-		env_runnable_head = env_runnable_tail = e;
-	}
-	else
-	{
-		e->env_link = env_runnable_head;
-		env_runnable_tail->env_link = e;
-		env_runnable_tail = e;
-	}
-	// 调试：遍历输出 env_runnable 链表
-	tmp = env_runnable_head;
-	printf("list ID: 0x%x \n", env_runnable_head->env_id);
-	while (tmp != env_runnable_tail)
-	{
-		printf(" 0x%x ", tmp->env_id);
-		tmp = tmp->env_link;
-	}
-	printf("\ntail ID: 0x%x \n", env_runnable_tail->env_id);
+	/* Step 4 (additional): 将 env 加到对应优先级的运行队列里*/
+	sched_insert(e);
+	kinfo(ENV, "env ID: 0x%x -> run queue %d\n", e->env_id, e->env_pri);
 }
 
 /* Overview:
@@ -630,168 +797,182 @@ void env_create_share(char *binary, int num, int priority)
 	e->env_pri = priority;
 
 	/*Step 3: Use load_icode() to load the named elf binary. */
-	printf("load_icode:%s\n", binary);
+	kinfo(ENV, "load_icode:%s\n", binary);
 	load_icode(e, binary);
 
-	/* Step 4 (additional): 将 env 加到 env_runnable 链表里*/
-	if (env_runnable_head == NULL)
-	{ // env_runnable 链表是否为空
-		e->env_link = e;
-		env_runnable_head = env_runnable_tail = e;
-	}
-	else
-	{
-		e->env_link = env_runnable_head;
-		env_runnable_tail->env_link = e;
-		env_runnable_tail = e;
-	}
-	// 调试：输出 env_runnable 链表的 head tail
-	printf("list ID: 0x%x \n", env_runnable_head->env_id);
-
-	struct Page *p = NULL;
-	u_long rr;
-	u_long perm;
-	p = create_share_vm(1, BY2PG); // todo 测试 key先都给1
-	p->pp_ref++;
-	if (p == NULL)
-	{
-		printf("alloc shared page failed\n");
-		return;
-	}
-	printf("alloc shared page success\n");
-	insert_share_vm(e, p);
-	printf("insert shared page success\n");
-	return;
+	/* Step 4 (additional): 将 env 加到对应优先级的运行队列里*/
+	sched_insert(e);
+	kinfo(ENV, "env ID: 0x%x -> run queue %d\n", e->env_id, e->env_pri);
 }
-// 创建一个轻量级线程（pthread）
-/*
-调用 env_alloc(&e, 0) 分配一个新的环境（线程）控制块 e。
-调用 copy_curenv(e, curenv, func, arg)。这个函数的作用是让新线程 e 与当前进程 curenv 共享大部分资源（特别是页表，除了栈）。同时，它会将 func 设置为新线程的入口点 (e->env_tf.cp0_epc)，并将 arg 放入合适的寄存器（如 $a0）。
-将新线程 e 添加到 env_runnable 循环链表中。
-*/
-void pthread_create(void *func, int arg)
+/* Overview:
+ *  Clone `parent` into a new env whose user pages are shared copy-on-write.
+ *  Writable pages lose PTE_R and gain PTE_COW in both address spaces, so the
+ *  first store from either side takes a TLB modified exception and
+ *  page_cow_fault copies that page only. Read-only and PTE_LIBRARY pages are
+ *  shared as they are. Shared memory segments live above UTOP and are not
+ *  copied here; shm_env_fork attaches each of them to the child instead.
+ *
+ * Pre-Condition:
+ *  `parent` is curenv (its stale TLB entries are dropped with its ASID), and
+ *  `tf` is its trapframe at the fork point.
+ *
+ * Post-Condition:
+ *  The child resumes from `tf` with v0 = 0; it is NOT put on a run queue.
+ *  Return 0 on success, < 0 on error.
+ */
+int env_fork(struct Env **new, struct Env *parent, struct Trapframe *tf)
 {
-	printf("pthread_create!!!!!!!!!!!!!!!!!\n");
 	struct Env *e;
+	Pte *pt;
+	u_int pdeno, pteno, va, perm;
 	int r;
-	printf("status : %x \n", get_status());
-	extern void debug();
 
-	// 首先, 调用 env_alloc 函数分配一个线程控制块 env
-	r = env_alloc(&e, 0);
-	if (r < 0)
+	if ((r = env_alloc(&e, parent->env_id)) < 0)
 	{
-		panic("sorry, env_create_priority:env_alloc failed");
-		return;
+		return r;
 	}
 
-	// 调用 copy_curenv 函数, 将 新创建的线程 与 当前运行的进程, 设定一些共享的资源, 如页表
-	copy_curenv(e, curenv, func, arg);
-
-	// 将 env 加入 env_runnable_list
-	if (env_runnable_head == NULL)
+	for (pdeno = 0; pdeno < PDX(UTOP); pdeno++)
 	{
-		// env 是第一个加入 list 的进程（线程）
-		printf("\nlist=null\n");
-		env_runnable_head = env_runnable_tail = e;
-		env_runnable_tail->env_link = env_runnable_head; // 成环
+		if (!(parent->env_pgdir[pdeno] & PTE_V))
+		{
+			continue;
+		}
+		pt = (Pte *)KADDR(PTE_ADDR(parent->env_pgdir[pdeno]));
+		for (pteno = 0; pteno <= PTX(~0); pteno++)
+		{
+			if (!(pt[pteno] & PTE_V))
+			{
+				continue;
+			}
+			va = (pdeno << PDSHIFT) | (pteno << PGSHIFT);
+			perm = pt[pteno] & 0xFFF;
+			if ((perm & PTE_R) && !(perm & PTE_LIBRARY))
+			{
+				// 可写页：父子都改成只读 + PTE_COW
+				perm = (perm & ~PTE_R) | PTE_COW;
+				pt[pteno] = PTE_ADDR(pt[pteno]) | perm;
+			}
+			if ((r = page_insert(e->env_pgdir, pa2page(PTE_ADDR(pt[pteno])), va, perm)) < 0)
+			{
+				tlb_invalidate_range(parent, 0, UTOP);
+				env_free(e);
+				return r;
+			}
+		}
 	}
-	else
+
+	// 父进程的可写页都改成了只读，TLB 里的旧项一次作废
+	tlb_invalidate_range(parent, 0, UTOP);
+
+	if ((r = shm_env_fork(e, parent->env_proc)) < 0)
 	{
-		printf("list!=null\n");
-		env_runnable_tail->env_link = e;
-		env_runnable_tail = e;
-		env_runnable_tail->env_link = env_runnable_head;
+		env_free(e);
+		return r;
+	}
+
+	e->env_tf = *tf;
+	e->env_tf.regs[2] = 0; // 子进程里 fork 返回 0
+	e->env_pri = parent->env_pri;
+	e->env_pgfault_handler = parent->env_pgfault_handler;
+	e->env_xstacktop = parent->env_xstacktop;
+	if (parent->env_tslot >= 0)
+	{ // 线程 fork 出来的子进程在同一个栈槽上继续跑，槽要占着
+		e->env_tstacks = 1u << parent->env_tslot;
 	}
-	printf("list ID: 0x%x \n", env_runnable_head->env_id);
+	*new = e;
+	return 0;
 }
 
-/*
- - 实现线程间的资源共享。让新线程 e 与源进程 env_src (即 curenv) 共享除栈之外的大部分内存资源。
- - 设置新线程的入口点 e->env_tf.cp0_epc = func 和参数 e->env_tf.regs[4] = arg。
- - 为新线程 e 分配一个新的页目录 pgdir。
-	跟当前进程共享的内容：
-	1. 堆（无）  全局变量 静态变量
-	2. 文件控制块 elf代码的入口地址
-*/
-void copy_curenv(struct Env *e, struct Env *env_src, void *func, int arg) // 不确定
+/* Overview:
+ *  Create a thread of curenv's process starting at func(arg). The thread
+ *  shares the process's page directory, ASID and shm attachments, so nothing
+ *  is copied; it gets its own trapframe and a UTSTACK_SIZE stack slot below
+ *  UTSTACKTOP whose pages are allocated by pageout on first touch.
+ *
+ * Pre-Condition:
+ *  `tf` is the caller's trapframe, the thread inherits its gp.
+ *
+ * Post-Condition:
+ *  The thread is put on the run queue with the process's priority. Returning
+ *  from func exits the thread only.
+ *  Return 0 and set *new on success, -E_NO_FREE_ENV if there is no free env
+ *  or stack slot left.
+ */
+int thread_create(struct Env **new, void *func, int arg, struct Trapframe *tf)
 {
-	Pte *pt;
-	u_int pdeno, pteno, pa;
-	e->env_tf.cp0_epc = func;
-	e->env_tf.regs[4] = arg;
-	printf("### curenv->CONTEXT: 0x%x \n", env_src->env_pgdir);
-	Pde *pgdir;			   // 新的一级页表项
-	struct Page *p = NULL; // 以及它对应的新页
-	int r;
+	struct Env *proc = curenv->env_proc;
+	struct Env *e;
+	int slot, r;
 
-	// 为新线程分配页目录页并加引用
-	if ((r = page_alloc(&p)) < 0)
+	if ((e = env_free_list) == NULL)
 	{
-		panic("env_setup_vm - page alloc error\n");
-		return;
+		return -E_NO_FREE_ENV;
 	}
-	p->pp_ref++;
-	pgdir = (Pde *)(page2kva(p));
-	printf("### e->CONTEXT: 0x%x \n", pgdir);
-	e->env_pgdir = pgdir; // 将这个新的一级页表项，作为 copy env 的页表项
-	for (pdeno = 0; pdeno < PDX(UTOP); pdeno++)
+	for (slot = 0; slot < NTSTACK; slot++)
 	{
-		/* Hint: only look at mapped page tables. */
-		if (!(env_src->env_pgdir[pdeno] & PTE_V))
-		{ // 如果原 env 的一级页表项，没有映射到二级页表地址
-			e->env_pgdir[pdeno] = 0;
-			continue;
-		}
-
-		/* Hint: find the pa and va of the page table. */
-		// e->env_pgdir[pdeno] = env_src->env_pgdir[pdeno]; // 直接拷贝二级页表地址，共享二级页表
-		printf("content:0x%x\n", e->env_pgdir[pdeno]);
-		pa = PTE_ADDR(env_src->env_pgdir[pdeno]); // 源二级页表物理地址
-		pt = (Pte *)KADDR(pa);					  // 源二级页表虚拟地址
-		pa2page(pa)->pp_ref++;					  // 增加二级页表的物理引用
-
-		/* Hint: Unmap all PTEs in this page table. */
-		for (pteno = 0; pteno <= PTX(~0); pteno++)
+		if (!(proc->env_tstacks & (1u << slot)))
 		{
-			if (pt[pteno] & PTE_V)
-			{
-				int pa_tmp = PTE_ADDR(pt[pteno]);
-				page_insert(e->env_pgdir, pa2page(pa_tmp), (pdeno << PDSHIFT) | (pteno << PGSHIFT), PTE_V | PTE_R);
-				pa2page(pa_tmp)->pp_ref++; // 增加物理页的物理引用
-			}
+			break;
 		}
 	}
-	// 线程具有自己独立的栈空间，因此，在拷贝完一级页表后，我们需要其中清空栈地址
-	// 这样，线程就拥有了自身独立的栈
-	for (pdeno = PDX(USTACKTOP); pdeno >= 0; pdeno--)
+	if (slot == NTSTACK)
 	{
-		// 清空栈地址
-		if (!(e->env_pgdir[pdeno] & PTE_V))
-		{
-			break;
-		}
-		pa = PTE_ADDR(env_src->env_pgdir[pdeno]); // 源二级页表物理地址
-		pt = (Pte *)KADDR(pa);					  // 源二级页表虚拟地址
-		pa2page(pa)->pp_ref--;					  // 减少二级页表的物理引用
-
-		// 减少栈区域所有页面的引用计数
-		for (pteno = 0; pteno <= PTX(~0); pteno++)
-		{
-			if (pt[pteno] & PTE_V)
-			{
-				int pa_tmp = PTE_ADDR(pt[pteno]);
-				pa2page(pa_tmp)->pp_ref--; // 减少物理页的物理引用
-			}
-		}
-		e->env_pgdir[pdeno] = 0;
+		return -E_NO_FREE_ENV;
 	}
+	if ((r = env_kstack_alloc(e)) < 0)
+	{
+		return r;
+	}
+	env_free_list = e->env_link;
+	proc->env_tstacks |= 1u << slot;
 
-	// 设置自映射
-	e->env_cr3 = PADDR(pgdir);
-	e->env_pgdir[PDX(VPT)] = e->env_cr3;
-	e->env_pgdir[PDX(UVPT)] = e->env_cr3 | PTE_V | PTE_R;
-	printf("### e->CONTEXT: 0x%x \n", e->env_pgdir);
+	e->env_id = mkenvid(e);
+	e->env_parent_id = proc->env_id;
+	e->env_status = ENV_RUNNABLE;
+	e->env_pgdir = proc->env_pgdir;
+	e->env_cr3 = proc->env_cr3;
+	e->env_proc = proc;
+	LIST_INIT(&e->env_threads);
+	LIST_INSERT_HEAD(&proc->env_threads, e, env_thread_link);
+	e->env_tstacks = 0;
+	e->env_tslot = slot;
+
+	bzero(&e->env_tf, sizeof(e->env_tf));
+	e->env_tf.cp0_status = 0x10007c01;
+	e->env_tf.cp0_epc = (u_long)func;
+	e->env_tf.regs[4] = arg;
+	e->env_tf.regs[25] = (u_long)func;  // t9，PIC 代码入口处用它算 gp
+	e->env_tf.regs[28] = tf->regs[28]; // gp 与创建者相同
+	e->env_tf.regs[29] = UTSTACKTOP - slot * UTSTACK_SIZE;
+	e->env_tf.regs[31] = 0x90000000; // 线程函数返回时走 print_addr_error -> env_free
+	e->env_runs = 0;
+	sched_env_init(e);
+	e->env_asid = 0; // 不用，ASID 记在 proc 上
+	bzero(&e->env_vm, sizeof(e->env_vm));
+	LIST_INIT(&e->env_shm);
+	e->env_ipc_recving = 0;
+	e->env_pri = proc->env_pri;
+	e->env_pgfault_handler = proc->env_pgfault_handler;
+	e->env_xstacktop = proc->env_xstacktop;
+
+	sched_insert(e);
+	kdebug(ENV, "thread 0x%x of env 0x%x: slot %d, entry 0x%x\n", e->env_id, proc->env_id, slot, func);
+	*new = e;
+	return 0;
+}
+
+// 控制块放回 env_free_list，并移出运行队列和等待队列、取消唤醒定时器；内核栈留着
+static void env_put(struct Env *e)
+{
+	sched_remove(e);
+	ktimer_cancel(&e->env_sleep_timer);
+	sched_unwait(e);
+	e->env_ksp = 0; // 阻塞在内核里的现场作废
+
+	e->env_status = ENV_FREE;
+	e->env_link = env_free_list; // e 指向 env_free_list 链表头
+	env_free_list = e;			 // 把新的链表头赋为 e
 }
 
 // 释放进程及其占用的所有资源
@@ -801,21 +982,52 @@ void copy_curenv(struct Env *e, struct Env *env_src, void *func, int arg) // 不
  * - 释放页目录本身
  * - 从可运行队列中移除
  * - 归还环境控制块
+ *  A thread only gives back its stack slot. Freeing a process frees all of
+ *  its threads along with the address space.
  */
-// 由于tlb_invalidate接口问题，现在只能释放curenv!!!
-// 由于tlb_invalidate接口问题，现在只能释放curenv!!!
+// e 不必是 curenv：用户页直接解除映射，TLB 里的项靠整体作废 ASID 处理
 int env_free(struct Env *e)
 {
 
 	Pte *pt;
 	u_int pdeno, pteno, pa;
+	struct Env *t;
+	u_long top;
+	int dead = (e == curenv); // curenv 被释放了，最后要另外调度
 
 	/* Hint: Note the environment's demise.*/
-	printf("free env->id: 0x%x isCur? %d\n", e->env_id, curenv == e);
+	kdebug(ENV, "free env->id: 0x%x isCur? %d\n", e->env_id, curenv == e);
+
+	if (e->env_proc != e)
+	{
+		// 线程：只拆它的栈槽，地址空间是进程的
+		top = UTSTACKTOP - e->env_tslot * UTSTACK_SIZE;
+		page_remove_range(e->env_proc, top - UTSTACK_SIZE, top);
+		e->env_proc->env_tstacks &= ~(1u << e->env_tslot);
+		LIST_REMOVE(e, env_thread_link);
+		e->env_pgdir = 0;
+		e->env_cr3 = 0;
+		env_put(e);
+		goto out;
+	}
+
+	// 其他线程跟着进程一起退出；它们的栈在下面随整个地址空间拆掉
+	while ((t = LIST_FIRST(&e->env_threads)) != NULL)
+	{
+		dead |= (t == curenv);
+		LIST_REMOVE(t, env_thread_link);
+		t->env_pgdir = 0;
+		t->env_cr3 = 0;
+		env_put(t);
+	}
+	e->env_tstacks = 0;
+
+	// 放掉共享内存的挂接，段里的页跟其他页一样由下面解除映射
+	shm_env_free(e);
 
 	/* Hint: Flush all mapped pages in the user portion of the address space */
-	// 释放该 env 所分配的所有内存页
-	for (pdeno = 0; pdeno < PDX(UTOP); pdeno++) // 遍历该进程的一级页表
+	// 释放该 env 所分配的所有内存页，包括共享内存窗口
+	for (pdeno = 0; pdeno < PDX(USHMTOP); pdeno++) // 遍历该进程的一级页表
 	{
 		/* Hint: only look at mapped page tables. */
 		if (!(e->env_pgdir[pdeno] & PTE_V))
@@ -829,10 +1041,11 @@ int env_free(struct Env *e)
 
 		/* Hint: Unmap all PTEs in this page table. */
 		for (pteno = 0; pteno <= PTX(~0); pteno++)
-		{ // 遍历调用 page_remove 函数清空二级页表
+		{ // 清空二级页表；不逐页清 TLB，下面整体作废 ASID
 			if (pt[pteno] & PTE_V)
 			{
-				page_remove(e->env_pgdir, (pdeno << PDSHIFT) | (pteno << PGSHIFT));
+				page_decref(pa2page(PTE_ADDR(pt[pteno])));
+				pt[pteno] = 0;
 			}
 		}
 
@@ -840,73 +1053,40 @@ int env_free(struct Env *e)
 		e->env_pgdir[pdeno] = 0;
 		page_decref(pa2page(pa)); // 释放
 	}
+	env_retire_asid(e);
+
 	/* Hint: free the page directory. */
 	pa = e->env_cr3;
 	e->env_pgdir = 0;
 	e->env_cr3 = 0;
 	page_decref(pa2page(pa));
 
-	// 从可运行队列中移除该进程
-	struct Env *tempE = env_runnable_head;
-	struct Env *tempE_pre = env_runnable_tail;
-	while (tempE != e)
-	{
-		tempE_pre = tempE;
-		tempE = tempE->env_link;
-		if (tempE == env_runnable_head) // 回到起点
-		{
-			return 0; // 没找到
-		}
-	}
-	// 现在我们找到了 e，tempE 指向 e，tempE_pre 是 e 前一个
-	// 先保存下一个要运行的进程
-	struct Env *next_env = e->env_link;
-
-	// 检查是否还有可运行的进程（如果 next_env == e，说明只有一个进程）
-	int has_runnable = (next_env != e);
+	// 从可运行队列中移除该进程，睡眠中的话取消唤醒定时器，把 e 加入 env_free_list
+	env_put(e);
 
-	// 从 env_runnable 里删去 e
-	tempE_pre->env_link = next_env;
-
-	// 更新链表头尾指针
-	if (env_runnable_head == e)
+out:
+	if (dead)
 	{
-		env_runnable_head = has_runnable ? next_env : NULL;
-	}
-	if (env_runnable_tail == e)
-	{
-		env_runnable_tail = has_runnable ? tempE_pre : NULL;
-	}
+		struct Env *next_env = sched_pick();
 
-	// 把 e 加入 env_free_list
-	e->env_status = ENV_FREE;
-	e->env_link = env_free_list; // e 指向 env_free_list 链表头
-	env_free_list = e;			 // 把新的链表头赋为 e
-
-	if (e == curenv)
-	{
 		clear_timer0_int();
-		if (has_runnable)
+		if (next_env != NULL)
 		{
 			// 还有其他可运行的进程，调度它
-			printf("next env->id: 0x%x  cur env->id: %x\n", next_env->env_id, curenv->env_id);
-			printf("free->sched \n");
+			kdebug(SCHED, "next env->id: 0x%x  cur env->id: %x\n", next_env->env_id, curenv->env_id);
+			kdebug(SCHED, "free->sched \n");
 			env_run(next_env);
 		}
 		else
 		{
-			// 没有可运行的进程了，进入空闲状态
-			printf("All processes finished. System idle.\n");
-			curenv = NULL;
-			while (1)
-			{
-				// 空闲循环，等待中断或新进程
-			}
+			// 没有可运行的进程了，进入空闲状态，等睡眠中的进程醒来
+			kinfo(SCHED, "No runnable process. System idle.\n");
+			sched_idle();
 		}
 	}
 	else
 	{
-		printf("env_free_not_current \n");
+		kdebug(ENV, "env_free_not_current \n");
 		return 1;
 	}
 }
@@ -925,26 +1105,48 @@ int env_free(struct Env *e)
 // 切换到环境 e 并运行它
 void env_run(struct Env *e)
 {
+	u_int asid;
+	u_long ksp;
 
+	tlb_charge_refills(curenv); // 之前的重填算在换下去的进程头上
 	curenv = e;
 	curenv->env_runs++; // 该进程已经跑过的次数
-	/*Step 3: Use lcontext() to switch to its address space. */
-	lcontext((curenv->env_pgdir), &(curenv->env_tf)); // 切换上下文
+	KERNEL_SP = (char *)(e->env_kstack + ENV_KSTKSIZE); // 之后的异常和系统调用都用 e 自己的内核栈
 
-	printf("### curenv-> ID: 0x%x  CONTEXT: 0x%x \n", curenv->env_id, curenv->env_pgdir);
-	printf("### curenv-> env_runs: %d nextenv->env_id: 0x%x\n", curenv->env_runs, curenv->env_link->env_id);
-	printf("### curenv-> epc:%x\n", curenv->env_tf.cp0_epc);
-	printf("----------------------------\n");
+	// 同一地址空间里的线程切换：页表基址、ASID 和固定项都还是对的，只换现场
+	if ((Pde *)mCONTEXT == e->env_pgdir && env_asid_live(e) &&
+		(get_asid() & ASID_MASK) == (e->env_proc->env_asid & ASID_MASK))
+	{
+		curtf = (int)&e->env_tf;
+	}
+	else
+	{
+		/*Step 3: Use lcontext() to switch to its address space. */
+		lcontext((curenv->env_pgdir), &(curenv->env_tf)); // 切换上下文
+
+		kdebug(SCHED, "### curenv-> ID: 0x%x  CONTEXT: 0x%x \n", curenv->env_id, curenv->env_pgdir);
+		kdebug(SCHED, "### curenv-> env_runs: %d env_pri: %d\n", curenv->env_runs, curenv->env_pri);
+		kdebug(SCHED, "### curenv-> epc:%x\n", curenv->env_tf.cp0_epc);
+		kdebug(SCHED, "----------------------------\n");
+		// ASID 按代分配（env_get_asid），不用每次切换都清 TLB；
+		// 先分 ASID（可能清空整个 TLB），再把用户栈写进固定项，最后设置 EntryHi 的 ASID
+		asid = env_get_asid(curenv);
+		tlb_wire_env(curenv);
+		set_asid(asid);
+	}
+
+	if ((ksp = e->env_ksp) != 0)
+	{
+		// e 阻塞在系统调用里（sched_block）：回到它的内核现场，由那次系统调用自己返回用户态。
+		// 当前这个栈上的现场不再需要，不保存
+		e->env_ksp = 0;
+		switch_to(NULL, ksp);
+	}
 	/*Step 4: Use env_pop_tf() to restore the environment's
 	 * environment   registers and drop into user mode in the
 	 * the   environment.
 	 */
-	/*environment registers and drop into user mode in the
-			*the environment.
-				* /
-		/* Hint: You should use GET_ENV_ASID there.Think why? */
-	set_asid(GET_ENV_ASID(curenv->env_id));
 	env_pop_tf(&(curenv->env_tf)); // 恢复上下文
 
-	// lcontext、set_asid、env_pop_tf，都在 env/env_asm.S 汇编里
+	// lcontext、set_asid、env_pop_tf、switch_to，都在 env/env_asm.S 汇编里
 }
@@ -1,11 +1,21 @@
 #include <env.h>
 #include <pmap.h>
 #include <printf.h>
+#include <log.h>
+#include <queue.h>
+#include <sched.h>
+#include <kclock.h>
+#include <ktimer.h>
+#include <workq.h>
+#include <mips/cpu.h>
 
 #define MAX_ENV_PRIORITY 5
-#define TIME_TO_MAKE_ENV_ALL_PRIORIST 5
+#define SCHED_BOOST_MS 1000 // 每隔这么久把所有进程捞到最高优先级
 
 extern u32 get_status();
+extern void env_pop_tf(struct Trapframe *tf);
+extern int curtf;
+extern char *KERNEL_SP;
 
 /* Overview:
  *  Implement simple round-robin scheduling.
@@ -16,11 +26,20 @@ extern u32 get_status();
  * Hints:
  *  The variable which is for counting should be defined as 'static'.
  */
-extern struct Env *env_runnable_head;
-extern struct Env *env_runnable_tail;
 extern struct Env *env_free_list;
 extern int cur_sched;
-extern int remaining_time = TIME_TO_MAKE_ENV_ALL_PRIORIST;
+
+// 各层的时间片（ms），层级越低时间片越长；0 层（ushell）不降级，沿用最长的时间片
+static const u_int sched_quantum_ms[MAX_ENV_PRIORITY + 1] = {160, 160, 80, 40, 20, 10};
+static u_int sched_quantum[MAX_ENV_PRIORITY + 1]; // 换算成 tick 数，见 sched_set_tick
+static u_int sched_boost_ticks;
+static int remaining_time; // 离下一次提升还剩多少个 tick
+u_int sched_ticks;		   // 开机以来的时钟中断次数
+
+TAILQ_HEAD(Env_sched_list, Env);
+static struct Env_sched_list env_sched_list[MAX_ENV_PRIORITY + 1]; // 每个优先级一条运行队列
+static u_int env_sched_bitmap;									   // 第 p 位为 1 表示 env_sched_list[p] 非空
+static u_int env_boost_gen;										   // 周期性提升的次数
 
 /*
 
@@ -32,117 +51,356 @@ MLFQ 规则：
   - 第二类：工作用完整个时间片后，降低其优先级（移入低一级队列）
 - 经过一段时间 S，就将系统中所有工作重新加入最高优先级队列
 
-仅有 syscall_all.c 的 sys_ipc_recv 函数（表示 curenv 想接收别的进程的通信，因此主动放弃时间片）是主动调用 sched_yield 的；
-（也就是说，curenv 调用 sys_ipc_recv 放弃时间片时，时间片还没用完；）
+主动放弃时间片的只有阻塞的系统调用（sys_ipc_recv、sys_sleep_ms 等，经 sched_block）；
+（也就是说，curenv 在系统调用里阻塞时，时间片还没用完；）
 所以，非常好区分 是否用完整个时间片。
 所以简单起见，我们采用第二类 MLFQ 规则。
-（其实计时也是可以的，可以去读 timer 的 counter，不过这样 env 的数据结构需要去改）
 
 为实现 MLFQ，我们需要
 1. 在 env 数据结构里维护优先级；
-2. 维护 离上次把所有进程捞到最高优先级 的时间（就用那个 remaining_time 了），时间到了就再捞一次。
+2. 维护 离上次把所有进程捞到最高优先级 的时间（remaining_time，按 tick 计），时间到了就再捞一次。
+
+时间片：时钟中断的周期（tick）编译时由 TICK_MS 确定（make TICK_MS=n，1~100 ms），启动时交给 kclock_init，
+每一层的时间片长度见 sched_quantum_ms，越低的层时间片越长，由 sched_set_tick 换算成 tick 数。
+时钟中断只进 sched_tick 记账：curenv->env_quantum_left 减一，还没用完就直接回到 curenv；
+用完了（或有更高优先级的进程在等）才调 sched_yield 真正切换。
+
+运行队列：每个优先级一条 TAILQ（env_sched_list），再用 env_sched_bitmap 记录哪些队列非空，
+选下一个进程时取 bitmap 最高位（clz）对应队列的队头，入队、出队、降级都是 O(1)。
+周期性提升也不遍历进程：把 1..MAX-1 层的队列整条接到最高层队尾，再把提升代数 env_boost_gen 加一；
+队列里进程的 env_pri 在下次被调度器用到时（sched_sync_pri）才改成 MAX_ENV_PRIORITY；
+提升时不在队列里的（睡眠、阻塞在 ipc_recv 或控制台上）在 sched_insert 重新入队时补上。
+优先级 0 的进程（如 ushell）不参与提升，也不降级，和原来一致。
 
 */
 
-// 每一次进行时钟中断时，都会跳转到该函数, 进行进程的调度
-void sched_yield()
+void sched_init(void)
 {
+	int i;
+	for (i = 0; i <= MAX_ENV_PRIORITY; i++)
+	{
+		TAILQ_INIT(&env_sched_list[i]);
+	}
+	env_sched_bitmap = 0;
+	env_boost_gen = 0;
+	sched_set_tick(TICK_MS);
+	ktimer_init();
+}
 
-	printf("\n\n### sched_yield -->CP0_status: 0x%x\n", get_status());
+// 按时钟中断周期 tick_ms 重新换算各层时间片和提升周期
+void sched_set_tick(u_int tick_ms)
+{
+	int i;
+	for (i = 0; i <= MAX_ENV_PRIORITY; i++)
+	{
+		sched_quantum[i] = sched_quantum_ms[i] / tick_ms;
+		if (sched_quantum[i] == 0)
+		{
+			sched_quantum[i] = 1;
+		}
+	}
+	sched_boost_ticks = SCHED_BOOST_MS / tick_ms;
+	if (sched_boost_ticks == 0)
+	{
+		sched_boost_ticks = 1;
+	}
+	remaining_time = sched_boost_ticks;
+}
 
-	struct Env *e = curenv;
-	struct Env *tempE = NULL;
+// 进程如果错过了提升（在队列里被整条接走，或者当时不在队列里），把 env_pri 补成最高优先级
+static void sched_sync_pri(struct Env *e)
+{
+	if (e->env_sched_gen != env_boost_gen)
+	{
+		if (e->env_pri > 0)
+		{
+			e->env_pri = MAX_ENV_PRIORITY;
+			e->env_quantum_left = sched_quantum[MAX_ENV_PRIORITY];
+		}
+		e->env_sched_gen = env_boost_gen;
+	}
+}
+
+// 新建的进程从当前的提升代数算起，之前的提升与它无关；时间片在入队时发放
+void sched_env_init(struct Env *e)
+{
+	e->env_quantum_left = 0;
+	e->env_sched_gen = env_boost_gen;
+}
+
+// 把 e 放到它所在优先级队列的队尾
+void sched_insert(struct Env *e)
+{
+	if (e->env_queued)
+	{
+		return;
+	}
+	sched_sync_pri(e);
+	if (e->env_pri > MAX_ENV_PRIORITY)
+	{
+		e->env_pri = MAX_ENV_PRIORITY;
+	}
+	if (e->env_quantum_left == 0)
+	{ // 新进程或刚用完时间片：按所在层发一个完整的时间片
+		e->env_quantum_left = sched_quantum[e->env_pri];
+	}
+	TAILQ_INSERT_TAIL(&env_sched_list[e->env_pri], e, env_sched_link);
+	env_sched_bitmap |= 1 << e->env_pri;
+	e->env_queued = 1;
+}
 
-	remaining_time -= 1; // 直接拿时间中断来粗略计时
-	if (remaining_time == 0)
+// 把 e 从运行队列中删去
+void sched_remove(struct Env *e)
+{
+	if (!e->env_queued)
+	{
+		return;
+	}
+	sched_sync_pri(e);
+	TAILQ_REMOVE(&env_sched_list[e->env_pri], e, env_sched_link);
+	if (TAILQ_EMPTY(&env_sched_list[e->env_pri]))
+	{
+		env_sched_bitmap &= ~(1 << e->env_pri);
+	}
+	e->env_queued = 0;
+}
+
+// 最高非空优先级队列的队头，没有可运行进程时返回 NULL
+struct Env *sched_pick(void)
+{
+	if (env_sched_bitmap == 0)
+	{
+		return NULL;
+	}
+	return TAILQ_FIRST(&env_sched_list[31 - __builtin_clz(env_sched_bitmap)]);
+}
+
+// 把所有 1..MAX-1 层的进程捞到最高优先级
+static void sched_boost(void)
+{
+	int i;
+	for (i = 1; i < MAX_ENV_PRIORITY; i++)
+	{
+		TAILQ_CONCAT(&env_sched_list[MAX_ENV_PRIORITY], &env_sched_list[i], env_sched_link);
+	}
+	if (env_sched_bitmap & ~1)
+	{
+		env_sched_bitmap = (env_sched_bitmap & 1) | (1 << MAX_ENV_PRIORITY);
+	}
+	env_boost_gen++;
+}
+
+/*
+ * 每一次时钟中断都经 irq_handle_resched（lib/irq.c）和 timer_irq（drivers/timer.c）进到这里，curenv 的现场已经存进 curtf。
+ * 只记账：时间片没用完就直接 env_pop_tf 回到 curenv，不切地址空间；
+ * 用完了交给 sched_yield 降级换人，有更高优先级的进程就绪时让出 CPU 但不降级。
+ * 不返回。
+ */
+void sched_tick(void)
+{
+	int top;
+
+	sched_ticks++;
+	tlb_charge_refills(curenv);
+	ktimer_tick();
+	workq_run(); // 时钟中断的下半部：到期的睡眠进程在这里重新入队，赶得上这一次调度
+	remaining_time -= 1;
+	if (remaining_time <= 0)
 	{ // 时间到了，把所有进程都捞到最高优先级
-		tempE = env_runnable_head;
-		do
-		{
-			if (tempE->env_pri > 0)
-			{
-				tempE->env_pri = MAX_ENV_PRIORITY;
-			}
-			tempE = tempE->env_link;
-		} while (tempE != env_runnable_head);
-		remaining_time = TIME_TO_MAKE_ENV_ALL_PRIORIST;
+		sched_boost();
+		remaining_time = sched_boost_ticks;
+	}
+
+	if (curenv == NULL || !curenv->env_queued)
+	{ // 第一次进时间中断，或 curenv 已经不在运行队列里
+		sched_yield();
 	}
+	sched_sync_pri(curenv);
+
+	if (curenv->env_quantum_left > 1)
+	{
+		curenv->env_quantum_left--;
+		top = 31 - __builtin_clz(env_sched_bitmap);
+		if (top > (int)curenv->env_pri)
+		{ // 更高优先级的进程就绪了，抢占但保留剩余时间片
+			sched_yield_voluntarily_giveup();
+		}
+		env_pop_tf(&curenv->env_tf);
+	}
+	curenv->env_quantum_left = 0;
+	sched_yield();
+}
+
+// curenv 用完了时间片（或已经不可运行），进行进程的调度
+void sched_yield()
+{
+
+	kdebug(SCHED, "\n\n### sched_yield -->CP0_status: 0x%x\n", get_status());
+
+	struct Env *e;
 
 	if (curenv == NULL)
 	{ // 第一次进时间中断
-		e = env_runnable_head;
-		printf("****************** first sched ******************* \n");
-	}
-	else
-	{ // 根据优先级进行调度
-		int highestPt = 0;
-		tempE = env_runnable_head;
-		// 遍历一次，同时维护最高优先级和优先级最高的进程
-		do
-		{
-			if (tempE->env_pri > highestPt)
-			{
-				highestPt = tempE->env_pri;
-				e = tempE;
-			}
-
-			tempE = tempE->env_link;
-
-		} while (tempE != env_runnable_head);
-
-		printf("\ncur env_id: 0x%x\n", curenv->env_id);
-		printf("next env_id: 0x%x\n", e->env_id);
-		if (e == NULL)
-		{ // todo 理论上不会出现, 得放个进程在里面
-			printf("fail! empty sched queue!!!\n");
-			while (1)
-				;
-		}
-		// curenv 优先级降一级
+		kdebug(SCHED, "****************** first sched ******************* \n");
+	}
+	else if (curenv->env_queued)
+	{ // 用完了时间片：curenv 优先级降一级，并排到所在队列队尾（同优先级轮转）
+		sched_remove(curenv);
 		if (curenv->env_pri > 1)
 			curenv->env_pri -= 1;
+		curenv->env_quantum_left = 0; // 按新的一层重新发时间片
+		sched_insert(curenv);
+	}
+
+	// 根据优先级进行调度
+	e = sched_pick();
+	if (e == NULL)
+	{ // 所有进程都在睡眠或等待
+		sched_idle();
+	}
+	if (curenv != NULL)
+	{
+		kdebug(SCHED, "\ncur env_id: 0x%x\n", curenv->env_id);
+		kdebug(SCHED, "next env_id: 0x%x\n", e->env_id);
 	}
 
 	env_run(e);
-	printf("\n!!!!!!!!!!!env: 0x%x has run!!!!!!\n", e->env_id);
+	kdebug(SCHED, "\n!!!!!!!!!!!env: 0x%x has run!!!!!!\n", e->env_id);
 }
 
 void sched_yield_voluntarily_giveup()
 {
 
-	printf("\n\n### sched_yield_voluntarily_giveup -->CP0_status: 0x%x\n", get_status());
+	kdebug(SCHED, "\n\n### sched_yield_voluntarily_giveup -->CP0_status: 0x%x\n", get_status());
 
-	struct Env *e = curenv;
+	struct Env *e;
 	if (curenv == NULL)
 	{ // 第一次进时间中断
-		e = env_runnable_head;
-		printf("****************** first sched ******************* \n");
-	}
-	else
-	{ // 根据优先级进行调度
-		int highestPt = 0;
-		struct Env *tempE = env_runnable_head;
-		// 遍历一次，同时维护最高优先级和优先级最高的进程
-		do
+		kdebug(SCHED, "****************** first sched ******************* \n");
+	}
+	else if (curenv->env_queued)
+	{ // 主动放弃，不降级，只排到队尾
+		sched_remove(curenv);
+		sched_insert(curenv);
+	}
+
+	// 根据优先级进行调度
+	e = sched_pick();
+	if (e == NULL)
+	{ // 所有进程都在睡眠或等待
+		sched_idle();
+	}
+	if (curenv != NULL)
+	{
+		kdebug(SCHED, "\ncur env_id: 0x%x\n", curenv->env_id);
+		kdebug(SCHED, "next env_id: 0x%x\n", e->env_id);
+	}
+
+	env_run(e);
+	kdebug(SCHED, "\n!!!!!!!!!!!env: 0x%x has run!!!!!!\n", e->env_id);
+}
+
+/*
+ * 在系统调用里阻塞 curenv。调用者已经把它移出运行队列（睡眠、等消息），
+ * 或者让它留在队列里只是让出 CPU。内核现场存进 curenv->env_ksp，
+ * 到启动栈上调度下一个进程；curenv 之后被 env_run 时从这里返回，
+ * 系统调用接着往下执行。
+ */
+void sched_block(void)
+{
+	switch_to_call(&curenv->env_ksp, KSTACK_IDLE, sched_yield_voluntarily_giveup);
+}
+
+static void sched_idle_loop(void)
+{
+	mips32_bicsr(SR_EXL | SR_UM); // 留在内核态
+	mips32_bissr(SR_IE);
+	while (1)
+	{
+		page_zero_refill(); // 空闲时预先清零空闲页
+		workq_run_idle();
+		if (env_sched_bitmap)
 		{
-			if (tempE->env_pri > highestPt)
-			{
-				highestPt = tempE->env_pri;
-				e = tempE;
-			}
-			tempE = tempE->env_link;
-		} while (tempE != env_runnable_head);
-
-		printf("\ncur env_id: 0x%x\n", curenv->env_id);
-		printf("next env_id: 0x%x\n", e->env_id);
-		if (e == NULL)
-		{ // todo 理论上不会出现, 得放个进程在里面
-			printf("fail! empty sched queue!!!\n");
-			while (1)
-				;
+			// 中断里唤醒了进程（比如控制台的读者），不等下一个 tick；
+			// 置回 EXL，和从中断进来调度时一样
+			mips32_bissr(SR_EXL);
+			sched_yield();
 		}
 	}
+}
 
-	env_run(e);
-	printf("\n!!!!!!!!!!!env: 0x%x has run!!!!!!\n", e->env_id);
-}
\ No newline at end of file
+/*
+ * 没有可运行进程时的空闲循环，不返回。
+ * 现场都已经存好（或者进程已经不在了），这里把 curtf 清零，SAVE_TF 就不会再往
+ * 哪个进程的 env_tf 里写；清 EXL、开中断，等时钟中断里 sched_tick 把醒来的进程调度上去。
+ * 空闲循环在启动栈上跑，时钟中断的 SAVE_TF 也切到这里，不会碰到阻塞进程的内核栈。
+ */
+void sched_idle(void)
+{
+	kdebug(SCHED, "sched: idle\n");
+	tlb_charge_refills(curenv);
+	curenv = NULL;
+	curtf = 0;
+	KERNEL_SP = (char *)KSTACK_IDLE;
+	switch_to_call(NULL, KSTACK_IDLE, sched_idle_loop);
+}
+
+// 睡眠定时器到期：进程重新回到运行队列
+static void sched_wakeup(void *arg)
+{
+	struct Env *e = arg;
+
+	if (e->env_status == ENV_NOT_RUNNABLE)
+	{
+		e->env_status = ENV_RUNNABLE;
+		sched_insert(e);
+	}
+}
+
+/*
+ * 等待队列：curenv 离开运行队列，按先后挂在 q 上，在系统调用里阻塞，
+ * 直到有人 sched_wake_all(q)。醒来不代表条件已经满足，调用者自己循环检查。
+ * 中断处理函数也可以调 sched_wake_all：中断只在用户态和空闲循环里进来，
+ * 不会打断正在改运行队列的内核代码。
+ */
+void sched_wait(struct env_waitq *q)
+{
+	struct Env *e = curenv;
+
+	sched_remove(e);
+	e->env_status = ENV_NOT_RUNNABLE;
+	e->env_waitq = q;
+	TAILQ_INSERT_TAIL(q, e, env_wait_link);
+	sched_block();
+}
+
+// 把 e 从它睡的等待队列上摘下来（不改状态），env_free 时用
+void sched_unwait(struct Env *e)
+{
+	if (e->env_waitq != NULL)
+	{
+		TAILQ_REMOVE(e->env_waitq, e, env_wait_link);
+		e->env_waitq = NULL;
+	}
+}
+
+// 唤醒 q 上的所有进程，放回运行队列
+void sched_wake_all(struct env_waitq *q)
+{
+	struct Env *e;
+
+	while ((e = TAILQ_FIRST(q)) != NULL)
+	{
+		sched_unwait(e);
+		e->env_status = ENV_RUNNABLE;
+		sched_insert(e);
+	}
+}
+
+// 让 e 离开运行队列睡 ms 毫秒，到期由时间轮唤醒；调用者负责之后切换进程
+void sched_sleep(struct Env *e, u_int ms)
+{
+	sched_remove(e);
+	e->env_status = ENV_NOT_RUNNABLE;
+	ktimer_add_ms(&e->env_sleep_timer, ms, sched_wakeup, e);
+}
@@ -2,6 +2,9 @@
 #include "ff.h"
 #include <stddef.h>
 #include "..\inc\printf.h"
+#include "../inc/log.h"
+#include "../inc/string.h"
+#include "../inc/hashmap.h"
 
 /* 共享库加载缓冲区（静态分配） */
 #define SO_BUF_SIZE 0x100000  /* 1MB */
@@ -10,56 +13,6 @@ static uint8_t so_load_buf[SO_BUF_SIZE] __attribute__((aligned(4)));
 /* 共享库加载后的动态链接信息 */
 static DynLinkInfo so_dyninfo;
 
-/**
- * 内存填充函数
- * Memory set function
- * s 目标内存指针
- * c 填充字节值
- * n 填充字节数
- * return 目标内存指针
- */
-static void *memSet(void *s, int c, size_t n)
-{
-  if (NULL == s || n < 0)
-    return NULL;
-  char * tmpS = (char *)s;
-  while(n-- > 0)
-    *tmpS++ = c;
-  return s;
-}
-
-/**
- * 内存拷贝函数
- * Memory copy function
- * dest 目标内存指针
- * src 源内存指针
- * n 拷贝字节数
- * return 成功返回 1，失败返回 0
- */
-int memCpy(void *dest, void *src, uint32_t n)
-{
-  if (NULL == dest || NULL == src || n < 0)
-    return 0;
-
-  uint32_t *tempDest = (uint32_t *)dest;
-  uint32_t *tempSrc = (uint32_t *)src;
-  uint32_t i = 0;
-
-  // Copy 4 bytes at a time - 每次拷贝 4 字节
-  for(i = 0; i < n / 4; i++) {
-    tempDest[i] = tempSrc[i];
-  }
-
-  // Copy remaining bytes - 拷贝剩余字节
-  char *destByte = (char *)dest + (i * 4);
-  char *srcByte = (char *)src + (i * 4);
-  for(i = 0; i < n % 4; i++) {
-    destByte[i] = srcByte[i];
-  }
-
-  return 1;
-}
-
 /**
  * 从内存加载 ELF 文件
  * Load ELF file from memory
@@ -79,7 +32,7 @@ int load_elf(const uint8_t *elf, const uint32_t elf_size) {
 
   // Check if file is too small - 检查文件大小是否太小
   if (elf_size < sizeof(Elf32_Ehdr)) {
-    printf("ELF file too small\n");
+    kerr(ELF, "ELF file too small\n");
     return -1;                            /* too small */
   }
 
@@ -87,13 +40,13 @@ int load_elf(const uint8_t *elf, const uint32_t elf_size) {
 
   // Check if it's a valid ELF32 file - 检查是否为有效的 ELF32 文件
   if (!IS_ELF32(*eh)) {
-    printf("Not a valid ELF32 file\n");
+    kerr(ELF, "Not a valid ELF32 file\n");
     return -1;                            /* not a elf32 file */
   }
 
   // Check if Program Headers are valid - 检查 Program Headers 是否有效
   if (eh->e_phoff + eh->e_phnum * sizeof(Elf32_Phdr) > elf_size) {
-    printf("ELF file internal damaged\n");
+    kerr(ELF, "ELF file internal damaged\n");
     return -1;                            /* internal damaged */
   }
 
@@ -106,14 +59,14 @@ int load_elf(const uint8_t *elf, const uint32_t elf_size) {
 
       // Copy segment data from file to memory - 从文件复制段数据到内存
       if(ph[i].p_filesz) {                         /* has data */
-        memCpy((void *)ph[i].p_vaddr,              // 目标虚拟地址
+        memcpy((void *)ph[i].p_vaddr,              // 目标虚拟地址
                (void *)(elf + ph[i].p_offset),     // 源文件偏移
                ph[i].p_filesz);                    // 文件中的大小
       }
 
       // Zero padding for BSS section - 对 BSS 段进行零填充
       if(ph[i].p_memsz > ph[i].p_filesz) {         /* zero padding */
-        memSet((void *)(ph[i].p_vaddr + ph[i].p_filesz),  // 填充起始地址
+        memset((void *)(ph[i].p_vaddr + ph[i].p_filesz),  // 填充起始地址
                0,                                          // 填充值为 0
                ph[i].p_memsz - ph[i].p_filesz);            // 填充大小
       }
@@ -130,18 +83,18 @@ static uint32_t load_so_file(const char *so_name) {
     FRESULT fr;
     uint32_t br;
 
-    printf("dynlink: Loading shared library: %s\n", so_name);
+    kinfo(ELF, "dynlink: Loading shared library: %s\n", so_name);
 
     /* 打开 .so 文件 */
     fr = f_open(&fil, so_name, FA_READ);
     if (fr != FR_OK) {
-        printf("dynlink: Failed to open %s (error %d)\n", so_name, fr);
+        kerr(ELF, "dynlink: Failed to open %s (error %d)\n", so_name, fr);
         return 0;
     }
 
     /* 检查文件大小 */
     if (fil.fsize > SO_BUF_SIZE) {
-        printf("dynlink: %s too large (%d > %d)\n", so_name, fil.fsize, SO_BUF_SIZE);
+        kerr(ELF, "dynlink: %s too large (%d > %d)\n", so_name, fil.fsize, SO_BUF_SIZE);
         f_close(&fil);
         return 0;
     }
@@ -149,7 +102,7 @@ static uint32_t load_so_file(const char *so_name) {
     /* 读取整个文件到缓冲区 */
     fr = f_read(&fil, so_load_buf, fil.fsize, &br);
     if (fr != FR_OK || br != fil.fsize) {
-        printf("dynlink: Failed to read %s\n", so_name);
+        kerr(ELF, "dynlink: Failed to read %s\n", so_name);
         f_close(&fil);
         return 0;
     }
@@ -159,13 +112,13 @@ static uint32_t load_so_file(const char *so_name) {
 
     /* 验证 ELF 格式 */
     if (so_size < sizeof(Elf32_Ehdr)) {
-        printf("dynlink: %s too small\n", so_name);
+        kerr(ELF, "dynlink: %s too small\n", so_name);
         return 0;
     }
 
     const Elf32_Ehdr *eh = (const Elf32_Ehdr *)so_load_buf;
     if (!IS_ELF32(*eh)) {
-        printf("dynlink: %s is not a valid ELF32 file\n", so_name);
+        kerr(ELF, "dynlink: %s is not a valid ELF32 file\n", so_name);
         return 0;
     }
 
@@ -188,7 +141,7 @@ static uint32_t load_so_file(const char *so_name) {
     uint32_t load_offset = 0;
     if (first_vaddr == 0) {
         load_offset = 0x20000000;  /* 共享库加载到 512MB 处 */
-        printf("dynlink: PIC library, using load offset 0x%x\n", load_offset);
+        kdebug(ELF, "dynlink: PIC library, using load offset 0x%x\n", load_offset);
     }
 
     uint32_t so_base = load_offset + first_vaddr;
@@ -199,24 +152,24 @@ static uint32_t load_so_file(const char *so_name) {
             uint32_t load_addr = load_offset + ph[i].p_vaddr;
 
             if (ph[i].p_filesz) {
-                memCpy((void *)load_addr,
+                memcpy((void *)load_addr,
                        (void *)(so_load_buf + ph[i].p_offset),
                        ph[i].p_filesz);
             }
 
             if (ph[i].p_memsz > ph[i].p_filesz) {
-                memSet((void *)(load_addr + ph[i].p_filesz),
+                memset((void *)(load_addr + ph[i].p_filesz),
                        0,
                        ph[i].p_memsz - ph[i].p_filesz);
             }
 
-            printf("dynlink: Loaded segment to 0x%x (size=%x)\n", load_addr, ph[i].p_memsz);
+            kdebug(ELF, "dynlink: Loaded segment to 0x%x (size=%x)\n", load_addr, ph[i].p_memsz);
         }
     }
 
     /* 解析共享库的动态节 */
     if (parse_dynamic_section(so_load_buf, so_size, &so_dyninfo) != 0) {
-        printf("dynlink: Failed to parse %s dynamic section\n", so_name);
+        kerr(ELF, "dynlink: Failed to parse %s dynamic section\n", so_name);
         return 0;
     }
 
@@ -235,17 +188,17 @@ static uint32_t load_so_file(const char *so_name) {
         so_dyninfo.got = (uint32_t *)(load_offset + got_vaddr);
         so_dyninfo.base_addr = load_offset;  /* 记录加载偏移，用于符号地址计算 */
 
-        printf("dynlink: Adjusted SO addresses: symtab=%x, strtab=%x, base=%x\n",
+        kdebug(ELF, "dynlink: Adjusted SO addresses: symtab=%x, strtab=%x, base=%x\n",
                (uint32_t)so_dyninfo.symtab, (uint32_t)so_dyninfo.strtab, load_offset);
     }
 
     /* 填充共享库自己的 GOT 表（用于访问自己的全局变量） */
     if (fill_got_table(&so_dyninfo, NULL) != 0) {
-        printf("dynlink: Failed to fill %s GOT table\n", so_name);
+        kerr(ELF, "dynlink: Failed to fill %s GOT table\n", so_name);
         return 0;
     }
 
-    printf("dynlink: %s loaded at base 0x%x\n", so_name, so_base);
+    kinfo(ELF, "dynlink: %s loaded at base 0x%x\n", so_name, so_base);
     return so_base;
 }
 
@@ -270,7 +223,7 @@ int load_elf_sd(const uint8_t *elf, const uint32_t elf_size) {
 
   // Check if file is too small - 检查文件大小
   if (elf_size < sizeof(Elf32_Ehdr)) {
-    printf("ELF file too small\n");
+    kerr(ELF, "ELF file too small\n");
     return -1;                             /* too small */
   }
 
@@ -278,13 +231,13 @@ int load_elf_sd(const uint8_t *elf, const uint32_t elf_size) {
 
   // Check if it's a valid ELF32 file - 检查是否为有效的 ELF32 文件
   if (!IS_ELF32(*eh)) {
-    printf("Not a valid ELF32 file\n");
+    kerr(ELF, "Not a valid ELF32 file\n");
     return -1;                             /* not a elf32 file */
   }
 
   // Check if Program Headers are valid - 检查 Program Headers 是否有效
   if (eh->e_phoff + eh->e_phnum * sizeof(Elf32_Phdr) > elf_size) {
-    printf("ELF file internal damaged\n");
+    kerr(ELF, "ELF file internal damaged\n");
     return -1;                             /* internal damaged */
   }
 
@@ -297,19 +250,19 @@ int load_elf_sd(const uint8_t *elf, const uint32_t elf_size) {
       if(ph[i].p_filesz) {                         /* has data */
         // Additional validation for SD card data - SD 卡数据的额外验证
         if (ph[i].p_offset + ph[i].p_filesz > elf_size) {
-          printf("Segment exceeds file size\n");
+          kerr(ELF, "Segment exceeds file size\n");
           return -1;                                   /* internal damaged */
         }
 
         // Copy segment data - 复制段数据
-        memCpy((void *)ph[i].p_vaddr,
+        memcpy((void *)ph[i].p_vaddr,
                (void *)(elf + ph[i].p_offset),
                ph[i].p_filesz);
       }
 
       // Zero padding for BSS section - 对 BSS 段进行零填充
       if(ph[i].p_memsz > ph[i].p_filesz) {         /* zero padding */
-        memSet((void *)(ph[i].p_vaddr + ph[i].p_filesz),
+        memset((void *)(ph[i].p_vaddr + ph[i].p_filesz),
                0,
                ph[i].p_memsz - ph[i].p_filesz);
       }
@@ -326,12 +279,12 @@ int load_elf_sd(const uint8_t *elf, const uint32_t elf_size) {
     return 0;
   }
 
-  printf("dynlink: Detected dynamic linking, processing...\n");
+  kinfo(ELF, "dynlink: Detected dynamic linking, processing...\n");
 
   /* 解析主程序的动态节 */
   DynLinkInfo main_info;
   if (parse_dynamic_section(elf, elf_size, &main_info) != 0) {
-    printf("dynlink: Failed to parse main program dynamic section\n");
+    kerr(ELF, "dynlink: Failed to parse main program dynamic section\n");
     return -1;
   }
 
@@ -349,7 +302,7 @@ int load_elf_sd(const uint8_t *elf, const uint32_t elf_size) {
           /* 加载共享库 */
           uint32_t so_base = load_so_file(so_name);
           if (so_base == 0) {
-            printf("dynlink: Failed to load required library %s\n", so_name);
+            kerr(ELF, "dynlink: Failed to load required library %s\n", so_name);
             return -1;
           }
           has_so = 1;
@@ -361,11 +314,11 @@ int load_elf_sd(const uint8_t *elf, const uint32_t elf_size) {
 
   /* 填充 GOT 表 */
   if (fill_got_table(&main_info, has_so ? &so_dyninfo : NULL) != 0) {
-    printf("dynlink: Failed to fill GOT table\n");
+    kerr(ELF, "dynlink: Failed to fill GOT table\n");
     return -1;
   }
 
-  printf("dynlink: Dynamic linking complete!\n");
+  kinfo(ELF, "dynlink: Dynamic linking complete!\n");
   return 0;
 }
 
@@ -475,7 +428,7 @@ int parse_dynamic_section(const uint8_t *elf, const uint32_t elf_size,
     info->base_addr = (first_load_vaddr == 0) ? 0 : 0;
 
     if (!dyn) {
-        printf("dynlink: No PT_DYNAMIC segment found\n");
+        kerr(ELF, "dynlink: No PT_DYNAMIC segment found\n");
         return -1;
     }
 
@@ -506,7 +459,7 @@ int parse_dynamic_section(const uint8_t *elf, const uint32_t elf_size,
                 break;
             case DT_NEEDED:
                 /* 记录需要的共享库（字符串表偏移） */
-                printf("dynlink: DT_NEEDED at offset %d\n", dyn[i].d_val);
+                kdebug(ELF, "dynlink: DT_NEEDED at offset %d\n", dyn[i].d_val);
                 break;
         }
     }
@@ -517,9 +470,9 @@ int parse_dynamic_section(const uint8_t *elf, const uint32_t elf_size,
     info->symtab = (Elf32_Sym *)symtab_addr;
     info->got = (uint32_t *)got_addr;
 
-    printf("dynlink: symtab=%x, strtab=%x, got=%x\n",
+    kdebug(ELF, "dynlink: symtab=%x, strtab=%x, got=%x\n",
            symtab_addr, strtab_addr, got_addr);
-    printf("dynlink: symtab_count=%d, local_gotno=%d, gotsym=%d\n",
+    kdebug(ELF, "dynlink: symtab_count=%d, local_gotno=%d, gotsym=%d\n",
            info->symtab_count, info->local_gotno, info->gotsym);
 
     return 0;
@@ -544,7 +497,7 @@ uint32_t lookup_symbol(const char *name, const DynLinkInfo *info)
             if (sym->st_shndx != 0) {
                 /* 符号地址 = 基址 + st_value */
                 uint32_t addr = info->base_addr + sym->st_value;
-                printf("dynlink: Found symbol '%s' at %x (base=%x, value=%x)\n",
+                kdebug(ELF, "dynlink: Found symbol '%s' at %x (base=%x, value=%x)\n",
                        name, addr, info->base_addr, sym->st_value);
                 return addr;
             }
@@ -554,6 +507,50 @@ uint32_t lookup_symbol(const char *name, const DynLinkInfo *info)
     return 0; /* 未找到 */
 }
 
+/* 符号名 -> 地址（已加上 base_addr） */
+HASHMAP_DEFINE(elf_symmap, const char *, uint32_t, hash_str, hash_eq_str)
+
+/**
+ * 给 info 中已定义的符号按名字建索引
+ * 同名符号保留第一个，与 lookup_symbol 的结果一致；内存不够时返回 -1
+ */
+static int elf_symmap_build(struct elf_symmap *m, const DynLinkInfo *info)
+{
+    elf_symmap_init(m);
+    if (!info || !info->symtab || !info->strtab) {
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < info->symtab_count; i++) {
+        const Elf32_Sym *sym = &info->symtab[i];
+        const char *sym_name = info->strtab + sym->st_name;
+
+        if (sym->st_shndx == 0 || elf_symmap_get(m, sym_name)) {
+            continue;
+        }
+        if (elf_symmap_put(m, sym_name, info->base_addr + sym->st_value) < 0) {
+            elf_symmap_destroy(m);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * 有索引时查索引，否则退回 lookup_symbol 的线性查找
+ */
+static uint32_t resolve_symbol(const char *name, struct elf_symmap *m,
+                               const DynLinkInfo *info, int indexed)
+{
+    uint32_t *addr;
+
+    if (!indexed) {
+        return lookup_symbol(name, info);
+    }
+    addr = elf_symmap_get(m, name);
+    return addr ? *addr : 0;
+}
+
 /**
  * 填充 GOT 表（MIPS 特定）
  *
@@ -568,16 +565,27 @@ uint32_t lookup_symbol(const char *name, const DynLinkInfo *info)
 int fill_got_table(DynLinkInfo *main_info, const DynLinkInfo *so_info)
 {
     if (!main_info || !main_info->got || !main_info->symtab || !main_info->strtab) {
-        printf("dynlink: Invalid main_info\n");
+        kerr(ELF, "dynlink: Invalid main_info\n");
         return -1;
     }
 
     /* 计算需要填充的 GOT 项数量 */
     uint32_t global_gotno = main_info->symtab_count - main_info->gotsym;
 
-    printf("dynlink: Filling %d GOT entries (starting at GOT[%d])\n",
+    kdebug(ELF, "dynlink: Filling %d GOT entries (starting at GOT[%d])\n",
            global_gotno, main_info->local_gotno);
 
+    /* 每个 GOT 项都线性扫一遍符号表是 O(GOT 项数 * 符号数)，先建索引 */
+    struct elf_symmap so_map, main_map;
+    int indexed = 0;
+    if (elf_symmap_build(&so_map, so_info) == 0) {
+        if (elf_symmap_build(&main_map, main_info) == 0) {
+            indexed = 1;
+        } else {
+            elf_symmap_destroy(&so_map);
+        }
+    }
+
     /* 遍历全局 GOT 项 */
     for (uint32_t i = 0; i < global_gotno; i++) {
         uint32_t got_index = main_info->local_gotno + i;
@@ -587,7 +595,7 @@ int fill_got_table(DynLinkInfo *main_info, const DynLinkInfo *so_info)
         const char *sym_name = main_info->strtab + sym->st_name;
 
         /* 调试：显示符号信息 */
-        printf("dynlink: sym[%d] '%s': shndx=%d, value=%x\n",
+        kdebug(ELF, "dynlink: sym[%d] '%s': shndx=%d, value=%x\n",
                sym_index, sym_name, sym->st_shndx, sym->st_value);
 
         /* 如果符号在主程序中已定义，使用主程序的地址 */
@@ -595,7 +603,7 @@ int fill_got_table(DynLinkInfo *main_info, const DynLinkInfo *so_info)
             /* 对于 PIC 代码，st_value 是相对地址，需要加上 base_addr */
             uint32_t addr = main_info->base_addr + sym->st_value;
             main_info->got[got_index] = addr;
-            printf("dynlink: GOT[%d] = %x (local: %s, base=%x, value=%x)\n",
+            kdebug(ELF, "dynlink: GOT[%d] = %x (local: %s, base=%x, value=%x)\n",
                    got_index, addr, sym_name, main_info->base_addr, sym->st_value);
             continue;
         }
@@ -603,24 +611,28 @@ int fill_got_table(DynLinkInfo *main_info, const DynLinkInfo *so_info)
         /* 在共享库中查找 */
         uint32_t addr = 0;
         if (so_info) {
-            addr = lookup_symbol(sym_name, so_info);
+            addr = resolve_symbol(sym_name, &so_map, so_info, indexed);
         }
 
         /* 如果共享库找不到，尝试在主程序符号表中搜索（可能是本地定义） */
         if (addr == 0) {
-            addr = lookup_symbol(sym_name, main_info);
+            addr = resolve_symbol(sym_name, &main_map, main_info, indexed);
         }
 
         if (addr != 0) {
             main_info->got[got_index] = addr;
-            printf("dynlink: GOT[%d] = %x (resolved: %s)\n",
+            kdebug(ELF, "dynlink: GOT[%d] = %x (resolved: %s)\n",
                    got_index, addr, sym_name);
         } else {
-            printf("dynlink: WARNING: Unresolved symbol '%s'\n", sym_name);
+            kerr(ELF, "dynlink: WARNING: Unresolved symbol '%s'\n", sym_name);
             /* 保持原值或设为 0 */
         }
     }
 
+    if (indexed) {
+        elf_symmap_destroy(&so_map);
+        elf_symmap_destroy(&main_map);
+    }
     return 0;
 }
 
@@ -638,18 +650,18 @@ int fill_got_table(DynLinkInfo *main_info, const DynLinkInfo *so_info)
 int load_elf_dynamic(const uint8_t *elf, const uint32_t elf_size,
                      uint32_t (*so_loader)(const char *so_name))
 {
-    printf("dynlink: Starting dynamic loading...\n");
+    kinfo(ELF, "dynlink: Starting dynamic loading...\n");
 
     /* 1. 首先用静态加载器加载 PT_LOAD 段 */
     if (load_elf(elf, elf_size) != 0) {
-        printf("dynlink: Failed to load PT_LOAD segments\n");
+        kerr(ELF, "dynlink: Failed to load PT_LOAD segments\n");
         return -1;
     }
 
     /* 2. 解析主程序的动态节 */
     DynLinkInfo main_info;
     if (parse_dynamic_section(elf, elf_size, &main_info) != 0) {
-        printf("dynlink: Failed to parse dynamic section\n");
+        kerr(ELF, "dynlink: Failed to parse dynamic section\n");
         return -1;
     }
 
@@ -668,13 +680,13 @@ int load_elf_dynamic(const uint8_t *elf, const uint32_t elf_size,
                 if (dyn[j].d_tag == DT_NEEDED && so_loader) {
                     /* 获取库名（从加载后的字符串表中读取） */
                     const char *so_name = main_info.strtab + dyn[j].d_val;
-                    printf("dynlink: Loading shared library: %s\n", so_name);
+                    kinfo(ELF, "dynlink: Loading shared library: %s\n", so_name);
 
                     /* 调用回调函数加载 .so 文件 */
                     /* load_so_file 会设置全局变量 so_dyninfo */
                     uint32_t so_base = so_loader(so_name);
                     if (so_base == 0) {
-                        printf("dynlink: Failed to load %s\n", so_name);
+                        kerr(ELF, "dynlink: Failed to load %s\n", so_name);
                         return -1;
                     }
                     has_so = 1;
@@ -686,11 +698,11 @@ int load_elf_dynamic(const uint8_t *elf, const uint32_t elf_size,
 
     /* 4. 填充 GOT 表，使用全局 so_dyninfo（由 load_so_file 设置） */
     if (fill_got_table(&main_info, has_so ? &so_dyninfo : NULL) != 0) {
-        printf("dynlink: Failed to fill GOT table\n");
+        kerr(ELF, "dynlink: Failed to fill GOT table\n");
         return -1;
     }
 
-    printf("dynlink: Dynamic loading complete!\n");
+    kinfo(ELF, "dynlink: Dynamic loading complete!\n");
     return 0;
 }
 
@@ -40,6 +40,8 @@
 #define STATUSF_IP4 0x100
 #define STATUSF_IP2 0x400
 #define STATUSF_IP0 0x400
+#define STATUSF_TIMER 0x400 /* 定时器接在硬件中断 0（Cause.IP2） */
+#define STATUSF_UART 0x800  /* UART 接在硬件中断 1（Cause.IP3） */
 #define STATUS_CU0 0x10000000
 #define	STATUS_KUC 0x2
 #endif
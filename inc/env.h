@@ -6,13 +6,17 @@
 #include "types.h"
 #include "queue.h"
 #include "trap.h"
+#include "ktimer.h"
+#include "vmstat.h"
+#include "shm.h"
 #include <mmu.h>
 
 #define LOG2NENV 10
 #define NENV (1 << LOG2NENV)
 #define ENVX(envid) ((envid) & (NENV - 1))
-// #define GET_ENV_ASID(envid) (((envid)>> 11)<<6)
-#define GET_ENV_ASID(envid) (envid & 0xFF)
+// ASID 由 env_get_asid 分配，见 env/env.c
+#define NASID 256
+#define ASID_MASK (NASID - 1)
 
 // Values of env_status in struct Env
 #define ENV_FREE 0
@@ -21,6 +25,9 @@
 #define ENV_SUSPEND 3
 #define dying 4
 
+LIST_HEAD(env_thread_list, Env);
+TAILQ_HEAD(env_waitq, Env); // 等待队列，见 sched_wait
+
 struct Env
 {
 	struct Trapframe env_tf; // Saved registers，用来存储进程的上下文，
@@ -34,8 +41,12 @@ struct Env
 	u_int env_status;	  // Status of the environment
 	Pde *env_pgdir;		  // Kernel virtual address of page dir, 存储当前进程的页表的虚拟地址
 	u_int env_cr3;
-	// LIST_ENTRY(Env) env_sched_link;
+	TAILQ_ENTRY(Env) env_sched_link; // 所在优先级运行队列的链接
 	u_int env_pri;
+	u_int env_sched_gen; // 入队/上次同步优先级时的提升代数，见 sched.c
+	u_int env_queued;	 // 是否在运行队列中
+	u_int env_quantum_left; // 当前时间片还剩多少个 tick，0 表示入队时重新发放
+	struct ktimer env_sleep_timer; // sys_sleep_ms 的唤醒定时器
 	// Lab 4 IPC
 	u_int env_ipc_value;   // data value sent to us
 	u_int env_ipc_from;	   // envid of the sender
@@ -50,11 +61,24 @@ struct Env
 	// Lab 6 scheduler counts
 	u_int env_runs; // number of times been env_run'ed，该进程已经跑过的次数
 	u_int env_nop;	// align to avoid mul instruction
-	u_int heap_pc;
+	struct shm_attach_list env_shm; // 挂接的共享内存段，见 mm/shm.c
 	uint32_t va;
 
-	/* ASID֧��*/
-	u_int env_asid; /* Address Space ID (0-255) */
+	u_int env_asid; // 高位是分配时的 ASID 代数，低 8 位是硬件 ASID，0 表示还没分配过
+	struct vm_env_stat env_vm; // 虚存计数，见 inc/vmstat.h
+
+	// 线程：同一进程的线程共用 env_pgdir、ASID 和共享内存挂接（都记在进程上），
+	// 各自只有现场和一个用户栈槽，见 thread_create
+	struct Env *env_proc;					  // 所属进程，进程（主线程）指向自己
+	struct env_thread_list env_threads;		  // 进程的其他线程
+	LIST_ENTRY(Env) env_thread_link;		  // 挂在 env_proc->env_threads 上
+	u_int env_tstacks;						  // 进程已分配的线程栈槽，按位
+	int env_tslot;							  // 线程占用的栈槽，进程为 -1
+
+	u_long env_kstack; // 内核栈（kseg0，ENV_KSTKSIZE 字节），第一次用到时分配，之后跟着这个控制块
+	u_long env_ksp;	   // 阻塞在内核里时 switch_to 存下的栈指针，否则为 0
+	struct env_waitq *env_waitq;	 // 睡在哪个等待队列上，没有为 NULL
+	TAILQ_ENTRY(Env) env_wait_link; // 挂在 env_waitq 上
 };
 struct EnvNode
 {
@@ -66,8 +90,6 @@ extern struct Env *envs;   // All environments, 包含我们所有的进程控
 extern struct Env *curenv; // the current env
 // extern struct Env_list env_sched_list[2]; // runnable env list
 
-extern struct Env *env_runnable_head;
-extern struct Env *env_runnable_tail;
 extern struct Env *env_free_list;
 
 extern u32 get_status(void);
@@ -76,13 +98,23 @@ extern u32 get_badvaddr(void);
 extern u32 get_cause(void);
 extern u32 get_epc(void);
 extern u32 get_asid(void);
+extern void set_asid(u32 id);
+// 内核现场切换，见 env/env_asm.S
+extern void switch_to(u_long *save_sp, u_long sp);
+extern void switch_to_call(u_long *save_sp, u_long sp, void (*fn)(void));
 
 void env_init(void);
 int env_alloc(struct Env **e, u_int parent_id);
 int env_free(struct Env *);
+int env_fork(struct Env **new, struct Env *parent, struct Trapframe *tf);
+int thread_create(struct Env **new, void *func, int arg, struct Trapframe *tf);
 void env_create_priority(char *binary, int priority);
 void env_create(char *binary, int *pt);
 
 int envid2env(u_int envid, struct Env **penv, int checkperm);
+u_int env_get_asid(struct Env *e);
+extern u_int asid_rollovers;
+int env_asid_live(struct Env *e);
+void env_retire_asid(struct Env *e);
 void env_run(struct Env *e);
 #endif
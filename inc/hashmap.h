@@ -0,0 +1,309 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef _HASHMAP_H_
+#define _HASHMAP_H_
+
+#include <types.h>
+#include <error.h>
+
+/*
+ * 通用哈希表：开放定址、线性探测，容量是 2 的幂。
+ *
+ *   HASHMAP_DEFINE(name, ktype, vtype, hashfn, eqfn)
+ *
+ * 在用到它的 .c 里展开出 struct name 和下面这些 static 函数：
+ *   name##_init(m)              清空，不分配内存
+ *   name##_get(m, key)          返回值的地址，没有返回 NULL
+ *   name##_put(m, key, val)     插入或覆盖，返回 0 或 -E_NO_MEM
+ *   name##_del(m, key)          删除，返回 1 表示原来有
+ *   name##_size(m)              元素个数
+ *   name##_destroy(m)           释放表，回到 init 之后的状态
+ * hashfn(key) 返回 u_int，eqfn(a, b) 相等时非 0；下面提供了整数和字符串的。
+ *
+ * 删除留下墓碑，探测链不会断；墓碑后面紧挨着空槽时，连同前面的墓碑一起清掉。
+ * 已用槽加墓碑超过 3/4 时换一张新表：元素多就扩成两倍，主要是墓碑就按原大小重建。
+ * 换表是渐进的：旧表留着，之后每次 put/del 顺带搬 HASHMAP_MIGRATE 个旧槽，
+ * get 两张表都查，单次操作的耗时不会因为扩容突然变长。
+ * 表的内存默认来自页分配器（lib/hashmap.c），在包含本文件前定义 HASHMAP_ALLOC
+ * 和 HASHMAP_FREE 可以换成别的分配函数，比如在主机上编译时（tests/hashmap_test.c，
+ * 在 tests 目录下 make test / make bench）。
+ */
+#ifndef HASHMAP_ALLOC
+void *hashmap_alloc(u_long bytes);
+void hashmap_free(void *p, u_long bytes);
+#define HASHMAP_ALLOC hashmap_alloc
+#define HASHMAP_FREE hashmap_free
+#endif
+
+#define HASHMAP_MIGRATE 4	  // 每次修改顺带搬迁的旧表槽数，不小于 4 才能在新表填满 3/4 前搬完
+#define HASHMAP_CHUNK 4096 // 第一张表按一页的大小定容量
+
+#define HM_EMPTY 0
+#define HM_FULL 1
+#define HM_TOMB 2
+
+// 32 位整数混合（lowbias32），相邻的键也会散到不同的槽
+static inline u_int hash_u32(u_int x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352d;
+	x ^= x >> 15;
+	x *= 0x846ca68b;
+	x ^= x >> 16;
+	return x;
+}
+
+// FNV-1a
+static inline u_int hash_str(const char *s)
+{
+	u_int h = 2166136261u;
+
+	while (*s)
+	{
+		h ^= (u_char)*s++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static inline int hash_eq_str(const char *a, const char *b)
+{
+	while (*a && *a == *b)
+	{
+		a++;
+		b++;
+	}
+	return *a == *b;
+}
+
+#define hash_int(k) hash_u32((u_int)(k))
+#define hash_eq_int(a, b) ((a) == (b))
+
+static inline u_int hashmap_first_cap(u_int slot_size)
+{
+	u_int cap = 8;
+
+	while (cap * 2 * slot_size <= HASHMAP_CHUNK)
+	{
+		cap *= 2;
+	}
+	return cap;
+}
+
+#define HASHMAP_DEFINE(name, ktype, vtype, hashfn, eqfn)                                       \
+	struct name##_slot                                                                         \
+	{                                                                                          \
+		ktype key;                                                                             \
+		vtype val;                                                                             \
+		u_char st; /* HM_* */                                                                  \
+	};                                                                                         \
+                                                                                               \
+	struct name                                                                                \
+	{                                                                                          \
+		struct name##_slot *tab;                                                               \
+		u_int cap;                                                                             \
+		u_int used;	 /* tab 里的元素 */                                                        \
+		u_int tombs; /* tab 里的墓碑 */                                                        \
+		u_int size;	 /* 两张表的元素总数 */                                                    \
+		struct name##_slot *old; /* 还在搬迁的旧表 */                                          \
+		u_int old_cap;                                                                         \
+		u_int old_pos;                                                                         \
+	};                                                                                         \
+                                                                                               \
+	static inline void name##_init(struct name *m)                                             \
+	{                                                                                          \
+		m->tab = m->old = NULL;                                                                \
+		m->cap = m->used = m->tombs = m->size = 0;                                             \
+		m->old_cap = m->old_pos = 0;                                                           \
+	}                                                                                          \
+                                                                                               \
+	static inline struct name##_slot *name##_probe(struct name##_slot *tab, u_int cap, ktype key) \
+	{                                                                                          \
+		u_int i, n;                                                                            \
+                                                                                               \
+		if (tab == NULL)                                                                       \
+		{                                                                                      \
+			return NULL;                                                                       \
+		}                                                                                      \
+		for (i = hashfn(key) & (cap - 1), n = 0; n < cap; i = (i + 1) & (cap - 1), n++)        \
+		{                                                                                      \
+			if (tab[i].st == HM_EMPTY)                                                         \
+			{                                                                                  \
+				return NULL;                                                                   \
+			}                                                                                  \
+			if (tab[i].st == HM_FULL && eqfn(tab[i].key, key))                                 \
+			{                                                                                  \
+				return &tab[i];                                                                \
+			}                                                                                  \
+		}                                                                                      \
+		return NULL;                                                                           \
+	}                                                                                          \
+                                                                                               \
+	/* s 刚变成墓碑：它后面是空槽的话，往前把连着的墓碑都清成空槽，返回清掉的个数 */ \
+	static inline u_int name##_untomb(struct name##_slot *tab, u_int cap, struct name##_slot *s) \
+	{                                                                                          \
+		u_int i = s - tab, n = 0;                                                              \
+                                                                                               \
+		if (tab[(i + 1) & (cap - 1)].st != HM_EMPTY)                                           \
+		{                                                                                      \
+			return 0;                                                                          \
+		}                                                                                      \
+		while (tab[i].st == HM_TOMB)                                                           \
+		{                                                                                      \
+			tab[i].st = HM_EMPTY;                                                              \
+			n++;                                                                               \
+			i = (i - 1) & (cap - 1);                                                           \
+		}                                                                                      \
+		return n;                                                                              \
+	}                                                                                          \
+                                                                                               \
+	/* key 不在任何一张表里，tab 也还有空位 */                                                 \
+	static inline void name##_place(struct name *m, ktype key, vtype val)                      \
+	{                                                                                          \
+		u_int i = hashfn(key) & (m->cap - 1);                                                  \
+                                                                                               \
+		while (m->tab[i].st == HM_FULL)                                                        \
+		{                                                                                      \
+			i = (i + 1) & (m->cap - 1);                                                        \
+		}                                                                                      \
+		if (m->tab[i].st == HM_TOMB)                                                           \
+		{                                                                                      \
+			m->tombs--;                                                                        \
+		}                                                                                      \
+		m->tab[i].key = key;                                                                   \
+		m->tab[i].val = val;                                                                   \
+		m->tab[i].st = HM_FULL;                                                                \
+		m->used++;                                                                             \
+		m->size++;                                                                             \
+	}                                                                                          \
+                                                                                               \
+	/* 从旧表搬 n 个槽到 tab，搬完就释放旧表 */                                                \
+	static inline void name##_migrate(struct name *m, u_int n)                                 \
+	{                                                                                          \
+		struct name##_slot *s;                                                                 \
+                                                                                               \
+		while (m->old != NULL && n-- > 0)                                                      \
+		{                                                                                      \
+			s = &m->old[m->old_pos++];                                                         \
+			if (s->st == HM_FULL)                                                              \
+			{ /* 搬走的留墓碑，后面还没搬的靠它接上探测链 */                                   \
+				s->st = HM_TOMB;                                                               \
+				m->size--;                                                                     \
+				name##_place(m, s->key, s->val);                                               \
+			}                                                                                  \
+			if (m->old_pos == m->old_cap)                                                      \
+			{                                                                                  \
+				HASHMAP_FREE(m->old, m->old_cap * sizeof(*s));                                 \
+				m->old = NULL;                                                                 \
+				m->old_cap = m->old_pos = 0;                                                   \
+			}                                                                                  \
+		}                                                                                      \
+	}                                                                                          \
+                                                                                               \
+	static inline int name##_rehash(struct name *m)                                            \
+	{                                                                                          \
+		struct name##_slot *tab;                                                               \
+		u_int cap = m->cap, i;                                                                 \
+                                                                                               \
+		name##_migrate(m, ~0u);                                                                \
+		if (cap == 0)                                                                          \
+		{                                                                                      \
+			cap = hashmap_first_cap(sizeof(*tab));                                             \
+		}                                                                                      \
+		else if (m->used * 2 >= cap)                                                           \
+		{                                                                                      \
+			cap *= 2;                                                                          \
+		}                                                                                      \
+		if ((tab = HASHMAP_ALLOC(cap * sizeof(*tab))) == NULL)                                 \
+		{                                                                                      \
+			return -E_NO_MEM;                                                                  \
+		}                                                                                      \
+		for (i = 0; i < cap; i++)                                                              \
+		{                                                                                      \
+			tab[i].st = HM_EMPTY;                                                              \
+		}                                                                                      \
+		m->old = m->tab;                                                                       \
+		m->old_cap = m->cap;                                                                   \
+		m->old_pos = 0;                                                                        \
+		m->tab = tab;                                                                          \
+		m->cap = cap;                                                                          \
+		m->used = m->tombs = 0;                                                                \
+		return 0;                                                                              \
+	}                                                                                          \
+                                                                                               \
+	static inline vtype *name##_get(struct name *m, ktype key)                                 \
+	{                                                                                          \
+		struct name##_slot *s;                                                                 \
+                                                                                               \
+		if ((s = name##_probe(m->tab, m->cap, key)) == NULL &&                                 \
+			(s = name##_probe(m->old, m->old_cap, key)) == NULL)                               \
+		{                                                                                      \
+			return NULL;                                                                       \
+		}                                                                                      \
+		return &s->val;                                                                        \
+	}                                                                                          \
+                                                                                               \
+	static inline int name##_put(struct name *m, ktype key, vtype val)                         \
+	{                                                                                          \
+		struct name##_slot *s;                                                                 \
+                                                                                               \
+		name##_migrate(m, HASHMAP_MIGRATE);                                                    \
+		/* 已经有的就地覆盖，在旧表里的留着等搬迁 */                                           \
+		if ((s = name##_probe(m->tab, m->cap, key)) != NULL ||                                 \
+			(s = name##_probe(m->old, m->old_cap, key)) != NULL)                               \
+		{                                                                                      \
+			s->val = val;                                                                      \
+			return 0;                                                                          \
+		}                                                                                      \
+		if ((m->used + m->tombs + 1) * 4 > m->cap * 3 && name##_rehash(m) < 0)                 \
+		{                                                                                      \
+			return -E_NO_MEM;                                                                  \
+		}                                                                                      \
+		name##_place(m, key, val);                                                             \
+		return 0;                                                                              \
+	}                                                                                          \
+                                                                                               \
+	static inline int name##_del(struct name *m, ktype key)                                    \
+	{                                                                                          \
+		struct name##_slot *s;                                                                 \
+                                                                                               \
+		name##_migrate(m, HASHMAP_MIGRATE);                                                    \
+		if ((s = name##_probe(m->tab, m->cap, key)) != NULL)                                   \
+		{                                                                                      \
+			s->st = HM_TOMB;                                                                   \
+			m->used--;                                                                         \
+			m->tombs++;                                                                        \
+			m->tombs -= name##_untomb(m->tab, m->cap, s);                                      \
+		}                                                                                      \
+		else if ((s = name##_probe(m->old, m->old_cap, key)) != NULL)                          \
+		{                                                                                      \
+			s->st = HM_TOMB;                                                                   \
+			name##_untomb(m->old, m->old_cap, s);                                              \
+		}                                                                                      \
+		else                                                                                   \
+		{                                                                                      \
+			return 0;                                                                          \
+		}                                                                                      \
+		m->size--;                                                                             \
+		return 1;                                                                              \
+	}                                                                                          \
+                                                                                               \
+	static inline u_int name##_size(struct name *m)                                            \
+	{                                                                                          \
+		return m->size;                                                                        \
+	}                                                                                          \
+                                                                                               \
+	static inline void name##_destroy(struct name *m)                                          \
+	{                                                                                          \
+		if (m->tab != NULL)                                                                    \
+		{                                                                                      \
+			HASHMAP_FREE(m->tab, m->cap * sizeof(*m->tab));                                    \
+		}                                                                                      \
+		if (m->old != NULL)                                                                    \
+		{                                                                                      \
+			HASHMAP_FREE(m->old, m->old_cap * sizeof(*m->old));                                \
+		}                                                                                      \
+		name##_init(m);                                                                        \
+	}
+
+#endif /* _HASHMAP_H_ */
@@ -0,0 +1,46 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef _IRQ_H_
+#define _IRQ_H_
+
+#include <types.h>
+
+/*
+ * 中断分发：CP0 Cause 的 IP0..IP7 每条线一个表项，由驱动在初始化时注册。
+ * 同时有几条线挂起时按线号从高到低处理（IP7 最优先，和 MIPS 兼容模式的约定一致）。
+ *
+ * handle_int（lib/genex.S）按挂起的线选路径：
+ *   都是普通处理函数时走快速路径，只把调用者保存的寄存器压在内核栈上，处理完原路 eret；
+ *   有带 IRQF_RESCHED 的线挂起时走慢速路径，完整现场存进 curtf，
+ *   处理函数可以不返回（sched_tick 切换进程），普通处理函数先跑，带 IRQF_RESCHED 的最后跑。
+ * 处理函数都在中断上下文（EXL=1）里执行，不能睡眠。
+ */
+#define NIRQ 8
+
+#define IRQ_TIMER 2	 // 定时器，硬件中断 0（STATUSF_TIMER）
+#define IRQ_UART 3	 // UART，硬件中断 1（STATUSF_UART）
+#define IRQ_SPI 4	 // SD 卡的 SPI 控制器，硬件中断 2
+#define IRQ_BUTTON 5 // 按键，硬件中断 3
+
+#define IRQF_RESCHED 0x1 // 处理函数可能切换进程、不返回
+
+struct irq_desc
+{
+	void (*irq_handler)(void *arg);
+	void *irq_arg;
+	u_int irq_flags;
+	u_int irq_count; // 处理过的次数
+	const char *irq_name;
+};
+
+extern struct irq_desc irq_table[NIRQ];
+extern u_int irq_resched_mask; // 第 n 位为 1 表示 IPn 的处理函数带 IRQF_RESCHED，genex.S 用它选路径
+extern u_int irq_spurious;	   // 挂起了但没有处理函数的次数
+
+int irq_register(int line, void (*fn)(void *), void *arg, u_int flags, const char *name);
+void irq_unregister(int line);
+void irq_handle(void);
+void irq_handle_resched(void);
+void irq_print_stat(void);
+
+#endif /* _IRQ_H_ */
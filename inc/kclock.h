@@ -3,7 +3,19 @@
 #ifndef _KCLOCK_H_
 #define _KCLOCK_H_
 #define	IO_RTC		0xb5000100		/* RTC port */
+
+/*
+ * 时钟中断周期（ms），编译时确定，make TICK_MS=n 修改；启动时没有别的来源（没有引导参数，
+ * 也不读配置文件）。kclock_init 按传入的值设定，并限制在 [TICK_MS_MIN, TICK_MS_MAX]。
+ */
+#ifndef TICK_MS
+#define TICK_MS		10
+#endif
+#define TICK_MS_MIN	1
+#define TICK_MS_MAX	100
+
 #ifndef __ASSEMBLER__
-void kclock_init(void);
+extern unsigned int kclock_tick_ms;
+void kclock_init(unsigned int tick_ms);
 #endif /* !__ASSEMBLER__ */
 #endif
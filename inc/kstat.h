@@ -0,0 +1,16 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef _KSTAT_H_
+#define _KSTAT_H_
+
+/*
+ * sys_kstat 在控制台上打印的内核计数，按位选择（ushell/inc/kstat.h 是同一份定义）。
+ * 虚存相关的计数有自己的结构体，走 sys_vm_stat（vmstat.h）。
+ */
+#define KSTAT_WORKQ 0x1 // 推迟执行的工作队列：深度、入队/执行/丢弃次数、延迟
+#define KSTAT_DISK 0x2  // 块缓存：命中、未命中次数和当前的脏块数
+#define KSTAT_IRQ 0x4   // 各条中断线处理过的次数和没有处理函数的中断次数
+#define KSTAT_CONS 0x8  // 控制台：发送缓冲区满、只能等 UART 的次数，放不下丢掉的输入行数
+#define KSTAT_ALL 0xf
+
+#endif /* _KSTAT_H_ */
@@ -0,0 +1,32 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef _KTIMER_H_
+#define _KTIMER_H_
+
+#include <types.h>
+#include <queue.h>
+
+/*
+ * 内核超时：分层时间轮，由时钟中断（sched_tick）每个 tick 推进一格。
+ * 回调推迟到工作队列（inc/workq.h）里执行，同样是 EXL=1，不能睡眠，也不能调 sched_yield。
+ */
+struct ktimer
+{
+	LIST_ENTRY(ktimer) kt_link;
+	u_int kt_expires;		   // 到期的 tick（ktimer_now 的值）
+	void (*kt_fn)(void *arg); // 到期回调
+	void *kt_arg;
+	u_int kt_pending; // 是否挂在时间轮上
+};
+
+extern u_int ktimer_now;	 // 下一个要处理的 tick
+extern u_int ktimer_pending; // 挂在时间轮上的定时器个数
+
+void ktimer_init(void);
+void ktimer_add(struct ktimer *t, u_int ticks, void (*fn)(void *), void *arg);
+void ktimer_add_ms(struct ktimer *t, u_int ms, void (*fn)(void *), void *arg);
+int ktimer_cancel(struct ktimer *t);
+void ktimer_tick(void);
+u_int ktimer_ms_to_ticks(u_int ms);
+
+#endif /* _KTIMER_H_ */
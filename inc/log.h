@@ -0,0 +1,73 @@
+/*
+ * 内核日志
+ *
+ * 每个子系统有一个编译期级别 LOG_LEVEL_<子系统>，默认等于 LOG_LEVEL
+ * （include.mk 中 -DLOG_LEVEL=$(LOG_LEVEL)，发布版为 LOG_ERR）。
+ * 级别高于编译期级别的语句，条件是常量假，连同参数求值一起被编译器删掉；
+ * 编进来的语句再按运行期的 log_mask（每个子系统一位）决定是否输出。
+ *
+ * 调试版：make LOG_LEVEL=3
+ * 只打开某个子系统：make LOG_FLAGS=-DLOG_LEVEL_MM=3
+ */
+#ifndef _LOG_H_
+#define _LOG_H_
+
+#include <printf.h>
+
+#define LOG_NONE 0
+#define LOG_ERR 1	// 出错，发布版保留
+#define LOG_INFO 2	// 启动、加载程序之类的一次性信息
+#define LOG_DEBUG 3 // 调度、缺页、系统调用路径上的跟踪
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_ERR
+#endif
+
+/* 子系统编号，也是 log_mask 中的位号 */
+#define LOG_SUB_SCHED 0	  // env/sched.c 与 env_run
+#define LOG_SUB_ENV 1	  // 进程创建、加载、释放
+#define LOG_SUB_MM 2	  // 物理页、页表、缺页
+#define LOG_SUB_SYSCALL 3 // lib/syscall_all.c
+#define LOG_SUB_SHM 4	  // 共享内存
+#define LOG_SUB_ELF 5	  // fs/elf.c 动态链接
+#define LOG_SUB_RT 6	  // lib/rtThread.c 设备与银行家算法
+
+#ifndef LOG_LEVEL_SCHED
+#define LOG_LEVEL_SCHED LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_ENV
+#define LOG_LEVEL_ENV LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_MM
+#define LOG_LEVEL_MM LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_SYSCALL
+#define LOG_LEVEL_SYSCALL LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_SHM
+#define LOG_LEVEL_SHM LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_ELF
+#define LOG_LEVEL_ELF LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_RT
+#define LOG_LEVEL_RT LOG_LEVEL
+#endif
+
+/* 运行期开关，定义在 lib/printf.c，默认全开 */
+extern unsigned int log_mask;
+
+#define klog(sub, lvl, ...)                                                     \
+	do                                                                          \
+	{                                                                           \
+		if ((lvl) <= LOG_LEVEL_##sub && (log_mask & (1u << LOG_SUB_##sub))) \
+		{                                                                       \
+			printf(__VA_ARGS__);                                                \
+		}                                                                       \
+	} while (0)
+
+#define kerr(sub, ...) klog(sub, LOG_ERR, __VA_ARGS__)
+#define kinfo(sub, ...) klog(sub, LOG_INFO, __VA_ARGS__)
+#define kdebug(sub, ...) klog(sub, LOG_DEBUG, __VA_ARGS__)
+
+#endif /* _LOG_H_ */
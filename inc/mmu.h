@@ -41,6 +41,19 @@
 #define PTE_W 0x0008	   // Writable bit (根据MIPS标准)
 #define PTE_U 0x0010	   // User accessible bit
 
+/*
+ * 大页：PTE 的 [6:5] 位记录它所在大页的大小，大页里每个 4KB 页的 PTE 都照常填写，
+ * TLB 重填时两半都是同样大小的大页就写成一个大页项，见 mm/pmap.c 的 tlb_refill。
+ */
+#define PTE_PGSZ 0x0060	   // 大页大小位，0 表示普通 4KB 页
+#define PTE_64K 0x0020
+#define PTE_1M 0x0040
+#define PTE_16M 0x0060
+#define PTE_PGSHIFT(pte) (PGSHIFT + 4 * (((pte) & PTE_PGSZ) >> 5)) // log2(页大小)
+#define PTE_PGSIZE(pte) (1u << PTE_PGSHIFT(pte))
+#define PAGEMASK_4K 0x1800 // 本仓库写 4KB 页的 PageMask 一直用这个值
+#define PTE_PAGEMASK(pte) ((((PTE_PGSIZE(pte) >> PGSHIFT) - 1) << 13) | PAGEMASK_4K)
+
 /* 添加设备内存空间定义 */
 #define DEVSPACE 0x10000000 // Device memory space
 
@@ -103,12 +116,27 @@
 #define UPAGES (UVPT - PDMAP)  /* 用户页结构 - 0x7f800000 */
 #define UENVS (UPAGES - PDMAP) /* 用户环境结构 - 0x7f400000 */
 #define UTOP (UENVS - PDMAP)   /* 用户空间顶部 - 0x7f000000 */
+/* 共享内存由内核选址时放在这 4MB 里，fork 不复制这一段，见 mm/shm.c */
+#define USHM UTOP
+#define USHMTOP UENVS
 
 /* 其他相关定义 */
 #define UXSTACKTOP UTOP				 /* 用户异常栈顶 */
 #define USTACKTOP (UTOP - 2 * BY2PG) /* 用户栈顶 */
 
-#define TIMESTACK 0x82000000
+/* 线程栈：UTSTACKTOP 往下 NTSTACK 个槽，每槽 UTSTACK_SIZE，页在第一次访问时才分配 */
+#define UTSTACKTOP (UTOP - PDMAP)
+#define UTSTACK_SIZE (32 * BY2PG)
+#define NTSTACK 32
+
+/*
+ * 内核栈：每个进程/线程有自己的一块（ENV_KSTKSIZE，见 env_run），异常和系统调用都在上面跑，
+ * 系统调用因此可以在中途阻塞。KSTACK_IDLE 是启动栈，调度器和空闲循环在这上面跑。
+ */
+#define KSTACK_IDLE 0x80400000
+#define ENV_KSTKORDER 2
+#define ENV_KSTKSIZE (BY2PG << ENV_KSTKORDER)
+
 #define USTACKTOP (UTOP - 2 * BY2PG)
 
 #define UTEXT 0x15000000
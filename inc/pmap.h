@@ -11,6 +11,12 @@
 // 来作为记录一页内存的相关信息的数据结构
 LIST_HEAD(FreePageList, Page);
 
+// 空闲物理页用 buddy 分配器管理：阶为 k 的空闲块是 2^k 个物理地址连续、按 2^k 页对齐的页
+#define PAGE_MAX_ORDER 10 // 最大阶，一次最多分配 2^10 页（4MB）连续物理内存
+
+// pp_flags
+#define PP_FREE 0x1 // 该页是某个空闲块的头页，pp_order 有效
+
 struct Page
 {
     // pp_link 是当前节点指向链表中下一个节点的指针，其类型为 LIST_ENTRY(Page)
@@ -19,10 +25,31 @@ struct Page
 
     // pp_ref 用来记录这一物理页面的引用次数
     u_short pp_ref;
+
+    u_char pp_flags; // PP_*
+    u_char pp_order; // 空闲块的阶（仅对空闲块的头页有效）
 };
 
 extern struct Page *pages;
 
+/* TLB 替换策略：[0, tlb_nwired) 是 CP0 Wired 固定项，其余由 tlbwr 随机替换 */
+#ifndef TLB_WIRED
+#define TLB_WIRED 2 // 固定项个数，make TLB_WIRED=n 修改，0 表示不固定
+#endif
+extern u_int tlb_size;
+extern u_int tlb_nwired;
+extern u_long tlb_refills;
+extern u_long tlb_refills_slow;
+extern u_long tlb_evictions;
+extern u_long tlb_wired_writes;
+extern u_long tlb_sweeps;
+extern u_long tlb_refills_large;
+extern u_long vm_pageouts;
+extern u_long vm_cow_faults;
+extern u_long vm_pages_mapped;
+extern u_long vm_pt_pages;
+extern u_long page_alloc_failures;
+
 void set_physic_mm();
 void vm_init();
 void mips_init();
@@ -30,13 +57,31 @@ void page_init(void);
 void page_check();
 int page_alloc(struct Page **pp);
 void page_free(struct Page *pp);
+int page_alloc_nozero(struct Page **pp);
+int page_zero_refill(void);
+int page_alloc_order(struct Page **pp, u_int order);
+int page_alloc_order_nozero(struct Page **pp, u_int order);
+void page_free_order(struct Page *pp, u_int order);
+u_long page_nr_free(u_int order);
 void page_decref(struct Page *pp);
 int pgdir_walk(Pde *pgdir, u_long va, int create, Pte **ppte);
 int page_insert(Pde *pgdir, struct Page *pp, u_long va, u_int perm);
+int page_insert_large(Pde *pgdir, struct Page *pp, u_long va, u_int perm, u_long size);
 struct Page *page_lookup(Pde *pgdir, u_long va, Pte **ppte);
 void page_remove(Pde *pgdir, u_long va);
+struct Env;
 void tlb_invalidate(Pde *pgdir, u_long va);
+void tlb_invalidate_env(struct Env *e, u_long va);
+void tlb_invalidate_range(struct Env *e, u_long start, u_long end);
+void page_remove_range(struct Env *e, u_long start, u_long end);
 void tlb_out(u_int entryhi);
+void tlb_flush_all(void);
+void tlb_init(void);
+void tlb_wire_env(struct Env *e);
+void tlb_charge_refills(struct Env *e);
+struct vm_stat;
+void vm_stat_fill(struct Env *e, struct vm_stat *st);
+void page_cow_fault(u_long va, Pde *pgdir);
 void boot_map_segment(Pde *pgdir, u_long va, u_long size, u_long pa, int perm);
 u_long page2ppn(struct Page *pp);
 u_long page2pa(struct Page *pp);
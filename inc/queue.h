@@ -197,5 +197,65 @@
                 struct type **tqe_prev; /* address of previous next element */  \
         }
 
+/*
+ * Tail queue functions.
+ */
+#define TAILQ_INIT(head) do {                                           \
+                (head)->tqh_first = NULL;                                       \
+                (head)->tqh_last = &(head)->tqh_first;                          \
+        } while (0)
+
+#define TAILQ_EMPTY(head)       ((head)->tqh_first == NULL)
+
+#define TAILQ_FIRST(head)       ((head)->tqh_first)
+
+#define TAILQ_NEXT(elm, field)  ((elm)->field.tqe_next)
+
+#define TAILQ_LAST(head, headname)                                      \
+        (*(((struct headname *)((head)->tqh_last))->tqh_last))
+
+#define TAILQ_FOREACH(var, head, field)                                 \
+        for ((var) = TAILQ_FIRST((head));                               \
+                 (var);                                                 \
+                 (var) = TAILQ_NEXT((var), field))
+
+#define TAILQ_INSERT_HEAD(head, elm, field) do {                        \
+                if (((elm)->field.tqe_next = (head)->tqh_first) != NULL)        \
+                        (head)->tqh_first->field.tqe_prev =                     \
+                                        &(elm)->field.tqe_next;                 \
+                else                                                            \
+                        (head)->tqh_last = &(elm)->field.tqe_next;              \
+                (head)->tqh_first = (elm);                                      \
+                (elm)->field.tqe_prev = &(head)->tqh_first;                     \
+        } while (0)
+
+#define TAILQ_INSERT_TAIL(head, elm, field) do {                        \
+                (elm)->field.tqe_next = NULL;                                   \
+                (elm)->field.tqe_prev = (head)->tqh_last;                       \
+                *(head)->tqh_last = (elm);                                      \
+                (head)->tqh_last = &(elm)->field.tqe_next;                      \
+        } while (0)
+
+#define TAILQ_REMOVE(head, elm, field) do {                             \
+                if (((elm)->field.tqe_next) != NULL)                            \
+                        (elm)->field.tqe_next->field.tqe_prev =                 \
+                                        (elm)->field.tqe_prev;                  \
+                else                                                            \
+                        (head)->tqh_last = (elm)->field.tqe_prev;               \
+                *(elm)->field.tqe_prev = (elm)->field.tqe_next;                 \
+        } while (0)
+
+/*
+ * Append all elements of head2 to the tail of head1, leaving head2 empty.
+ */
+#define TAILQ_CONCAT(head1, head2, field) do {                          \
+                if (!TAILQ_EMPTY(head2)) {                                      \
+                        *(head1)->tqh_last = (head2)->tqh_first;                \
+                        (head2)->tqh_first->field.tqe_prev = (head1)->tqh_last; \
+                        (head1)->tqh_last = (head2)->tqh_last;                  \
+                        TAILQ_INIT((head2));                                    \
+                }                                                               \
+        } while (0)
+
 #endif  /* !_SYS_QUEUE_H_ */
 
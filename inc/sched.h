@@ -3,8 +3,23 @@
 #ifndef __SCHED_H__
 #define __SCHED_H__
 
+#include <env.h>
+
 void sched_init(void);
 void sched_yield(void);
+void sched_tick(void);
+void sched_set_tick(u_int tick_ms);
+void sched_idle(void);
+void sched_sleep(struct Env *e, u_int ms);
+void sched_block(void);
+void sched_wait(struct env_waitq *q);
+void sched_wake_all(struct env_waitq *q);
+void sched_unwait(struct Env *e);
+void sched_yield_voluntarily_giveup(void);
+void sched_env_init(struct Env *e);
+void sched_insert(struct Env *e);
+void sched_remove(struct Env *e);
+struct Env *sched_pick(void);
 void sched_intr(int); 
 
 #endif /* __SCHED_H__ */
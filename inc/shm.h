@@ -0,0 +1,48 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef _SHM_H_
+#define _SHM_H_
+
+#include <types.h>
+#include <queue.h>
+#include <mmu.h>
+
+/*
+ * 共享内存：按 key 命名的段，由若干物理页组成（能拿到物理连续的块就用连续的，
+ * 否则逐页分配）。进程每挂接一次段的 shm_nattach 加一，解除挂接减一，
+ * 减到 0 时段被销毁、页还给分配器；同一个 key 之后再申请得到的是新段。
+ */
+#define SHM_MAX_PAGES (PDMAP / BY2PG) // 段大小上限，正好是内核选址窗口的大小
+
+struct Page;
+struct Env;
+
+struct shm_seg
+{
+	int shm_key;
+	u_int shm_npages;
+	u_int shm_nattach;		  // 挂接次数，为 0 时销毁
+	struct Page *shm_block;	  // 物理连续时的首页，否则为 NULL
+	struct Page **shm_pages; // 不连续时的页指针数组（占一整页）
+};
+
+// 进程的一次挂接，挂在 e->env_shm 上，按 sa_va 升序
+struct shm_attach
+{
+	LIST_ENTRY(shm_attach) sa_link;
+	struct shm_seg *sa_seg;
+	u_long sa_va;
+};
+
+LIST_HEAD(shm_attach_list, shm_attach);
+
+extern u_int shm_nsegs;		// 现存的段数
+extern u_long shm_npages;	// 现存的段一共占用的物理页数
+
+void shm_init(void);
+int shm_attach(struct Env *e, int key, u_long size, u_long va, u_long *pva);
+int shm_detach(struct Env *e, u_long va);
+int shm_env_fork(struct Env *child, struct Env *parent);
+void shm_env_free(struct Env *e);
+
+#endif /* _SHM_H_ */
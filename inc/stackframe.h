@@ -73,7 +73,8 @@
 	ehb
 first_push:
 
-	li		sp,0x80400000//切到内核SP  
+	lui		sp,%hi(KERNEL_SP)//切到当前进程的内核栈（空闲时是启动栈）
+	lw		sp,%lo(KERNEL_SP)(sp)
 
 .endm
 
@@ -82,14 +83,16 @@ first_push:
 	mfc0	k1,CP0_EPC,2  //nested epc 
 	li	k0,-0x80000000
 	addu k1,k0;
-	bgez k1,core_save     //epc >= 0x80000000,嵌套
+	bgez k1,1f     //epc >= 0x80000000,嵌套（用局部标号，同一文件可以展开多次）
 	nop
 	move	k0,sp //原来的sp放进k0存起来  
-	li		sp,0x80400000//切到内核SP  
-	j handle_finish    
-core_save:
+	lui		sp,%hi(KERNEL_SP)//切到当前进程的内核栈，env_run 切换进程时设置
+	lw		sp,%lo(KERNEL_SP)(sp)//不经过 $at，它还没保存
+	j 2f    
+	nop     //延迟槽：在 noreorder 里展开时汇编器不会补，否则下面的 move 会把 k0 换成内核栈顶
+1:	//core_save
 	move	k0,sp //原来的sp放进k0存起来
-handle_finish:             
+2:	//handle_finish             
 	subu	sp,sp,TF_SIZE  
 
 	sw	k0,TF_REG29(sp) //存原来sp
@@ -141,6 +144,87 @@ handle_finish:
 
 .endm
 
+/*
+ * 中断快速路径用：只保存调用者保存的寄存器（at、v0-v1、a0-a3、t0-t9、ra）和 hi/lo、EPC，
+ * s0-s8、gp 由被调用的 C 函数自己保存。帧的布局沿用 Trapframe，没存的槽不用。
+ * 打断的是用户态时切到 KERNEL_SP，打断的是内核空闲循环（EPC >= 0x80000000）时就压在当前栈上。
+ */
+.macro SAVE_SOME
+	mfc0	k1,CP0_EPC
+	li	k0,-0x80000000
+	addu k1,k0
+	bgez k1,1f     //打断的是内核
+	nop
+	move	k0,sp
+	lui		sp,%hi(KERNEL_SP)
+	lw		sp,%lo(KERNEL_SP)(sp)
+	j 2f
+	nop     //延迟槽，同 SAVE_ALL
+1:
+	move	k0,sp
+2:
+	subu	sp,sp,TF_SIZE
+	sw	k0,TF_REG29(sp)
+	mfc0	k0,CP0_EPC
+	sw	k0,TF_EPC(sp)
+	mfhi	k0
+	sw	k0,TF_HI(sp)
+	mflo	k0
+	sw	k0,TF_LO(sp)
+	sw	$1,TF_REG1(sp)
+	sw	$2,TF_REG2(sp)
+	sw	$3,TF_REG3(sp)
+	sw	$4,TF_REG4(sp)
+	sw	$5,TF_REG5(sp)
+	sw	$6,TF_REG6(sp)
+	sw	$7,TF_REG7(sp)
+	sw	$8,TF_REG8(sp)
+	sw	$9,TF_REG9(sp)
+	sw	$10,TF_REG10(sp)
+	sw	$11,TF_REG11(sp)
+	sw	$12,TF_REG12(sp)
+	sw	$13,TF_REG13(sp)
+	sw	$14,TF_REG14(sp)
+	sw	$15,TF_REG15(sp)
+	sw	$24,TF_REG24(sp)
+	sw	$25,TF_REG25(sp)
+	sw	$31,TF_REG31(sp)
+
+.endm
+
+// 和 SAVE_SOME 配对，Status 没动过，不用恢复
+.macro RESTORE_SOME
+	lw	v1,TF_LO(sp)
+	mtlo	v1
+	lw	v0,TF_HI(sp)
+	mthi	v0
+	lw	v1,TF_EPC(sp)
+	mtc0	v1,CP0_EPC
+
+	lw	$31,TF_REG31(sp)
+	lw	$25,TF_REG25(sp)
+	lw	$24,TF_REG24(sp)
+	lw	$15,TF_REG15(sp)
+	lw	$14,TF_REG14(sp)
+	lw	$13,TF_REG13(sp)
+	lw	$12,TF_REG12(sp)
+	lw	$11,TF_REG11(sp)
+	lw	$10,TF_REG10(sp)
+	lw	$9,TF_REG9(sp)
+	lw	$8,TF_REG8(sp)
+	lw	$7,TF_REG7(sp)
+	lw	$6,TF_REG6(sp)
+	lw	$5,TF_REG5(sp)
+	lw	$4,TF_REG4(sp)
+	lw	$3,TF_REG3(sp)
+	lw	$2,TF_REG2(sp)
+	lw	$1,TF_REG1(sp)
+
+	lw	sp,TF_REG29(sp)
+	ehb
+
+.endm
+
 /*
  * Note that we restore the IE flags from stack. This means
  * that a modified IE mask will be nullified.
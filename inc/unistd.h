@@ -2,7 +2,7 @@
 #define UNISTD_H
 
 #define __SYSCALL_BASE 9527     //基地址 不用改
-#define __NR_SYSCALLS 36        //加系统调用需要加这个数
+#define __NR_SYSCALLS 41        //加系统调用需要加这个数
 
 
 #define SYS_putchar 		((__SYSCALL_BASE ) + (0 ) )
@@ -41,5 +41,10 @@
 #define SYS_rt_write_by_num  ((__SYSCALL_BASE ) + (33 ) )
 #define SYS_rt_exit          ((__SYSCALL_BASE ) + (34 ) )
 #define SYS_set_buzzer       ((__SYSCALL_BASE ) + (35 ) )
+#define SYS_fork             ((__SYSCALL_BASE ) + (36 ) )
+#define SYS_sleep_ms         ((__SYSCALL_BASE ) + (37 ) )
+#define SYS_vm_stat          ((__SYSCALL_BASE ) + (38 ) )
+#define SYS_shm_detach       ((__SYSCALL_BASE ) + (39 ) )
+#define SYS_kstat            ((__SYSCALL_BASE ) + (40 ) )
 
 #endif
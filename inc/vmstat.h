@@ -0,0 +1,47 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef _VMSTAT_H_
+#define _VMSTAT_H_
+
+#include <types.h>
+
+/*
+ * 虚存计数，由 sys_vm_stat 拷给用户态（ushell/inc/vmstat.h 是同一份定义）。
+ * 事件计数全局的从开机、进程的从创建起累计；pages_mapped/pt_pages 在进程里是
+ * 查询时遍历页表得到的当前值，在全局里是 page_insert/pgdir_walk 的累计次数。
+ */
+#define VM_STAT_ORDERS 11 // 与 PAGE_MAX_ORDER + 1 相同
+
+struct vm_env_stat
+{
+	u_int tlb_refills;	// TLB 重填（快速路径 + 慢速路径）
+	u_int pageouts;		// pageout 按需分配的清零页
+	u_int cow_faults;	// 写时复制缺页
+	u_int pages_mapped; // 映射的用户页
+	u_int pt_pages;		// 二级页表页
+};
+
+struct vm_stat
+{
+	struct vm_env_stat env; // sys_vm_stat 指定的进程
+	u_int tlb_refills;
+	u_int tlb_refills_slow;
+	u_int tlb_evictions;	 // 只在 make TLB_STATS=1 时统计
+	u_int tlb_refills_large; // 写成大页项的重填，算在 tlb_refills_slow 里
+	u_int tlb_wired_writes;	 // 写固定项的次数
+	u_int tlb_sweeps;		 // 整体扫描 TLB 的次数
+	u_int tlb_entries;		 // TLB 项数
+	u_int tlb_wired;		 // 其中固定项的个数（CP0 Wired）
+	u_int asid_rollovers;	 // ASID 发完换代、清空整个 TLB 的次数
+	u_int pageouts;
+	u_int cow_faults;
+	u_int pages_mapped;
+	u_int pt_pages;
+	u_int alloc_failures;				// page_alloc 系列分配失败
+	u_int zero_hits;					// page_alloc 从预清零页池取到页的次数
+	u_int zero_misses;					// 池是空的、只能当场清零的次数
+	u_int zero_pool;					// 池里现有的页数（也算在 free_blocks[0] 里）
+	u_int free_blocks[VM_STAT_ORDERS];	// 各阶空闲块数，第 k 阶每块 2^k 页
+};
+
+#endif /* _VMSTAT_H_ */
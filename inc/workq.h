@@ -0,0 +1,51 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef _WORKQ_H_
+#define _WORKQ_H_
+
+#include <types.h>
+
+/*
+ * 推迟执行的工作（下半部）：中断处理函数只做必须马上做的事，把剩下的挂到队列上，
+ * 由 workq_run 在这些地方统一执行：
+ *   返回用户态之前（genex.S 的 ret_from_exception 和中断快速路径）、
+ *   时钟中断记完账之后（sched_tick）、以及空闲循环里。
+ * workq_run 总在 EXL=1 时执行，中断进不来，所以每个队列只有一个生产者和一个消费者，
+ * 入队、出队各自只推进自己的下标，不用锁，也不用关中断。
+ * 工作函数和中断处理函数一样不能睡眠，也不能调 sched_yield。
+ */
+#define WQ_SIZE 32 // 每个队列最多同时挂的工作数，2 的幂
+
+struct work
+{
+	void (*w_fn)(void *arg);
+	void *w_arg;
+	u_int w_pending; // 已经在队列里了，再入队不会放第二份
+	u_int w_stamp;	 // 入队时的 CP0 Count
+};
+
+struct workq
+{
+	struct work *wq_ring[WQ_SIZE];
+	volatile u_int wq_head; // 下一个要执行的，只有 workq_run 推进
+	volatile u_int wq_tail; // 下一个空槽，只有 workq_add 推进
+	const char *wq_name;
+	struct workq *wq_next; // workq_run 按 workq_init 的先后依次处理
+	// 调优用的计数
+	u_int wq_added;		// 入队次数
+	u_int wq_done;		// 执行次数
+	u_int wq_dropped;	// 队列满、没放进去的次数
+	u_int wq_depth_max; // 出现过的最大深度
+	u_int wq_lat_max;	// 入队到开始执行的最长时间（CP0 Count 计数）
+	u_int wq_lat_avg;	// 同上的滑动平均，新样本占 1/8
+};
+
+#define WORK_INIT(fn, arg) {(fn), (arg), 0, 0}
+
+void workq_init(struct workq *q, const char *name);
+int workq_add(struct workq *q, struct work *w);
+void workq_run(void);
+void workq_run_idle(void);
+void workq_print_stat(void);
+
+#endif /* _WORKQ_H_ */
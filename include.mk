@@ -1,6 +1,21 @@
 CROSS_COMPILE := mips-mti-elf-
 CC			  := $(CROSS_COMPILE)gcc
-CFLAGS  = -EL -g -march=m14kc -msoft-float -O1 -I . -G0 -std=gnu11
+# 日志级别见 inc/log.h：1 只保留出错信息（发布版），3 打开全部调试输出
+LOG_LEVEL ?= 1
+LOG_FLAGS ?=
+# 调度 tick（ms），每层时间片按它换算，见 env/sched.c
+TICK_MS ?= 10
+# TLB 固定项（CP0 Wired）个数，见 mm/pmap.c 的 tlb_wire_env
+TLB_WIRED ?= 2
+CFLAGS  = -EL -g -march=m14kc -msoft-float -O1 -I . -G0 -std=gnu11 -DLOG_LEVEL=$(LOG_LEVEL) -DTICK_MS=$(TICK_MS) -DTLB_WIRED=$(TLB_WIRED) $(LOG_FLAGS)
+# make MEMBENCH=1：启动时运行 lib/membench.c 的 memcpy/memset 基准
+ifdef MEMBENCH
+CFLAGS += -DMEMBENCH
+endif
+# make TLB_STATS=1：TLB 快速重填时统计被换掉的有效项（多十几条指令）
+ifdef TLB_STATS
+CFLAGS += -DTLB_STATS
+endif
 # CFLAGS		  := -O -G 0 -mno-abicalls -fno-builtin -Wa,-xgot -Wall -fPIC
 LD			  := $(CROSS_COMPILE)ld
 OD = mips-mti-elf-objdump
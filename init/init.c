@@ -2,8 +2,10 @@
 #include <asm/asm.h>
 #include <pmap.h>
 #include <env.h>
+#include <shm.h>
 #include <printf.h>
 #include <kclock.h>
+#include <workq.h>
 #include <trap.h>
 #include <../inc/types.h>
 #include <../inc/rtThread.h>
@@ -11,6 +13,7 @@
 #include <../drivers/switches.h>
 #include <../drivers/seven_seg.h>
 #include <../drivers/vga_print.h>
+#include <../drivers/button.h>
 
 #define K_ENV 0x88000000
 #define KENV_A 0x88010000
@@ -19,7 +22,10 @@
 u32 v,t;
 
 extern int mCONTEXT;
-extern struct HashTable ht;
+
+#ifdef MEMBENCH
+void mem_bench(void);
+#endif
 
 void interface_init()
 {
@@ -52,6 +58,7 @@ void device_init()
     cons_init();
     init_seven_seg();
     led_init();
+    button_init();
     asid_list_init();
 
 
@@ -77,6 +84,9 @@ void sys_init()
     printf("\n");
     printf("*******Start to initialize page memory management:\n");
 	page_init();
+    printf("\n");
+    printf("*******Start to initialize the TLB:\n");
+	tlb_init();
 
     printf("\n");
     printf("*******Start to initialize process management:\n");
@@ -93,10 +103,15 @@ void sys_init()
 
     printf("kclock init has been completed\n");
     printf("\n");
+#ifdef MEMBENCH
+    printf("*******memcpy/memset benchmark:\n");
+    mem_bench();
+    printf("\n");
+#endif
     printf("*******The whole system is ready!\n");
 
     interface_init();               //initialize the interface
-    tryHashTableInit(&ht);
+    shm_init();
 
     printf("\n@@AFTER INIT: CP0_status: 0x%x\n\n",get_status());
 
@@ -128,9 +143,11 @@ void sys_init()
 
     asm ("ei");//中断使能
 
-    kclock_init();  //设置中断时间长短
+    kclock_init(TICK_MS);  //设置中断时间长短（调度 tick，编译时确定，见 inc/kclock.h）
                     //进时间中断后，下面不会被执行到
     while(1){
+        page_zero_refill(); // 空闲时预先清零空闲页
+        workq_run_idle();
 
         //rt_device_read(SWITCH_ID, &t);
         //rt_device_write(LED_ID,&t);
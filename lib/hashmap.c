@@ -0,0 +1,33 @@
+#include <hashmap.h>
+#include <pmap.h>
+
+/*
+ * HASHMAP_DEFINE 生成的哈希表默认从这里拿内存：按页分配物理连续的块，
+ * 大小向上取到 2 的幂个页。块已由 page_alloc_order 清零。
+ */
+static u_int hashmap_order(u_long bytes)
+{
+	u_int order = 0;
+
+	while ((BY2PG << order) < bytes)
+	{
+		order++;
+	}
+	return order;
+}
+
+void *hashmap_alloc(u_long bytes)
+{
+	struct Page *pp;
+
+	if (page_alloc_order(&pp, hashmap_order(bytes)) < 0)
+	{
+		return NULL;
+	}
+	return (void *)page2kva(pp);
+}
+
+void hashmap_free(void *p, u_long bytes)
+{
+	page_free_order(pa2page(PADDR(p)), hashmap_order(bytes));
+}
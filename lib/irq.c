@@ -0,0 +1,135 @@
+#include <irq.h>
+#include <env.h>
+#include <sched.h>
+#include <error.h>
+#include <workq.h>
+#include <printf.h>
+#include <mips/cpu.h>
+
+extern int curtf;
+extern void env_pop_tf(struct Trapframe *tf);
+
+struct irq_desc irq_table[NIRQ];
+u_int irq_resched_mask;
+u_int irq_spurious;
+
+/* Overview:
+ *  Install fn as the handler of interrupt line `line` (Cause.IP<line>) and
+ *  unmask the line in Status. Handlers that may switch envs and never return
+ *  (the scheduler tick) must pass IRQF_RESCHED.
+ *
+ * Post-Condition:
+ *  Return 0 on success, -E_INVAL if the line is out of range or already taken.
+ */
+int irq_register(int line, void (*fn)(void *), void *arg, u_int flags, const char *name)
+{
+	struct irq_desc *d;
+
+	if (line < 0 || line >= NIRQ || fn == NULL || irq_table[line].irq_handler)
+	{
+		return -E_INVAL;
+	}
+	d = &irq_table[line];
+	d->irq_arg = arg;
+	d->irq_flags = flags;
+	d->irq_count = 0;
+	d->irq_name = name;
+	d->irq_handler = fn;
+	if (flags & IRQF_RESCHED)
+	{
+		irq_resched_mask |= 1u << line;
+	}
+	mips32_bissr(SR_IM0 << line);
+	return 0;
+}
+
+// 只摘掉处理函数，不屏蔽这条线：用户态的 Status 来自 env_tf，屏蔽了也会被恢复回来
+void irq_unregister(int line)
+{
+	if (line < 0 || line >= NIRQ)
+	{
+		return;
+	}
+	irq_table[line].irq_handler = NULL;
+	irq_resched_mask &= ~(1u << line);
+}
+
+// 当前挂起且允许的中断线，第 n 位对应 IPn
+static u_int irq_pending(void)
+{
+	return ((mips32_getcr() & mips32_getsr()) >> 8) & 0xff;
+}
+
+// 按线号从高到低依次调用 pending 里各条线的处理函数
+static void irq_run(u_int pending)
+{
+	struct irq_desc *d;
+	int line;
+
+	while (pending)
+	{
+		line = 31 - __builtin_clz(pending);
+		pending &= ~(1u << line);
+		d = &irq_table[line];
+		if (d->irq_handler == NULL)
+		{ // 设备自己不打开中断就不会再来，这里只记个数
+			irq_spurious++;
+			continue;
+		}
+		d->irq_count++;
+		d->irq_handler(d->irq_arg);
+	}
+}
+
+/*
+ * 快速路径（genex.S 里 SAVE_SOME 之后）：只处理不带 IRQF_RESCHED 的线，
+ * 然后把处理函数推迟的工作跑掉再返回。
+ * 保存现场之后才挂起的 IRQF_RESCHED 线留着，eret 之后马上再进一次中断走慢速路径。
+ */
+void irq_handle(void)
+{
+	u_int pending = irq_pending();
+
+	if (pending == 0)
+	{
+		irq_spurious++;
+	}
+	irq_run(pending & ~irq_resched_mask);
+	workq_run();
+}
+
+/*
+ * 慢速路径（genex.S 里 SAVE_TF 之后）：普通处理函数和推迟的工作先跑，带 IRQF_RESCHED 的
+ * 最后跑，免得它们切换了进程，其它线要等下一次中断。
+ * 处理函数都返回了就回到被打断的地方：curtf 里是被打断的进程，为 0 说明打断的是空闲循环。
+ */
+void irq_handle_resched(void)
+{
+	u_int pending = irq_pending();
+
+	irq_run(pending & ~irq_resched_mask);
+	workq_run();
+	irq_run(pending & irq_resched_mask);
+	if (curtf)
+	{
+		env_pop_tf((struct Trapframe *)curtf);
+	}
+	sched_idle();
+}
+
+// 已注册的线各自处理过的次数，以及挂起了却没有处理函数的次数
+void irq_print_stat(void)
+{
+	struct irq_desc *d;
+	int line;
+
+	for (line = NIRQ - 1; line >= 0; line--)
+	{
+		d = &irq_table[line];
+		if (d->irq_handler)
+		{
+			printf("irq %d %s: %d\n", line, d->irq_name, d->irq_count);
+		}
+	}
+	printf("irq spurious: %d\n", irq_spurious);
+}
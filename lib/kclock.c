@@ -4,15 +4,24 @@
 /* The run time clock is hard-wired to IRQ8. */
 
 #include <kclock.h>
-#include <kclock.h>
+#include <sched.h>
+
+extern void init_timer(u32 ms);
 
-extern void init_timer();
+unsigned int kclock_tick_ms = TICK_MS;
 
+// 以 tick_ms 为周期启动时钟中断，并让调度器按这个周期换算时间片
 void
-kclock_init(void)
+kclock_init(unsigned int tick_ms)
 {
-	
+	if (tick_ms < TICK_MS_MIN)
+		tick_ms = TICK_MS_MIN;
+	if (tick_ms > TICK_MS_MAX)
+		tick_ms = TICK_MS_MAX;
+	kclock_tick_ms = tick_ms;
+
 	//set_timer();
-	init_timer();
+	sched_set_tick(tick_ms);
+	init_timer(tick_ms);
 }
 
@@ -0,0 +1,170 @@
+#include <ktimer.h>
+#include <kclock.h>
+#include <workq.h>
+
+/*
+ * 分层时间轮（与 Linux 早期的 timer wheel 相同的做法）：
+ *   共 KT_LEVELS 层，每层 KT_LVL_SIZE 个槽。到期时间与当前 tick 相差 delta 时，
+ *   delta < 64 放第 0 层，按 kt_expires 的低 6 位选槽；
+ *   delta < 64^2 放第 1 层，按 kt_expires 的 [11:6] 位选槽，依此类推。
+ * 每个 tick 只处理第 0 层的一个槽；第 0 层转满一圈时，把第 1 层当前槽里的定时器
+ * 重新插入（它们都落到第 0 层），第 1 层也转满一圈时再往上一层，以此类推。
+ * 每个定时器最多被搬 KT_LEVELS - 1 次，所以每个 tick 的均摊开销是 O(1)，
+ * 与挂着多少定时器无关；插入和取消都是 O(1)。
+ *
+ * 时钟中断里的 ktimer_tick 只记下又过了一个 tick，转时间轮和调回调都推迟到
+ * kt_wq 上的 ktimer_run 里做；还没转过去的 tick 数记在 ktimer_due。
+ */
+#define KT_LVL_BITS 6
+#define KT_LVL_SIZE (1 << KT_LVL_BITS)
+#define KT_LVL_MASK (KT_LVL_SIZE - 1)
+#define KT_LEVELS 4 // 覆盖 2^24 个 tick，1 ms 的 tick 下约 4.6 小时
+#define KT_MAX_DELTA ((1u << (KT_LVL_BITS * KT_LEVELS)) - 1)
+
+LIST_HEAD(ktimer_list, ktimer);
+static struct ktimer_list kt_wheel[KT_LEVELS][KT_LVL_SIZE];
+
+u_int ktimer_now;
+u_int ktimer_pending;
+static u_int ktimer_due; // 已经过去、还没被 ktimer_run 处理的 tick 数
+
+static void ktimer_run(void *arg);
+static struct workq kt_wq;
+static struct work kt_work = WORK_INIT(ktimer_run, NULL);
+
+void ktimer_init(void)
+{
+	int i, j;
+	for (i = 0; i < KT_LEVELS; i++)
+	{
+		for (j = 0; j < KT_LVL_SIZE; j++)
+		{
+			LIST_INIT(&kt_wheel[i][j]);
+		}
+	}
+	ktimer_now = 0;
+	ktimer_pending = 0;
+	ktimer_due = 0;
+	workq_init(&kt_wq, "ktimer");
+}
+
+// 按离 ktimer_now 的距离把 t 挂到对应层的槽上
+static void ktimer_enqueue(struct ktimer *t)
+{
+	u_int delta = t->kt_expires - ktimer_now;
+	int lvl;
+
+	if (delta > KT_MAX_DELTA)
+	{ // 超出时间轮范围的按最远的距离处理
+		delta = KT_MAX_DELTA;
+		t->kt_expires = ktimer_now + delta;
+	}
+	for (lvl = 0; lvl < KT_LEVELS - 1; lvl++)
+	{
+		if (delta < (1u << (KT_LVL_BITS * (lvl + 1))))
+		{
+			break;
+		}
+	}
+	LIST_INSERT_HEAD(&kt_wheel[lvl][(t->kt_expires >> (KT_LVL_BITS * lvl)) & KT_LVL_MASK], t, kt_link);
+}
+
+u_int ktimer_ms_to_ticks(u_int ms)
+{
+	return (ms + kclock_tick_ms - 1) / kclock_tick_ms;
+}
+
+// ticks 个完整的 tick 之后调用 fn(arg)；t 已经挂着的话先取消
+void ktimer_add(struct ktimer *t, u_int ticks, void (*fn)(void *), void *arg)
+{
+	if (t->kt_pending)
+	{
+		ktimer_cancel(t);
+	}
+	// ktimer_now 这个 tick 已经过去了一部分，从下一个 tick 开始算才能保证至少等够 ticks 个；
+	// 时间轮还落后 ktimer_due 个 tick，从真正的当前 tick 算起
+	t->kt_expires = ktimer_now + ktimer_due + (ticks ? ticks : 1);
+	t->kt_fn = fn;
+	t->kt_arg = arg;
+	t->kt_pending = 1;
+	ktimer_pending++;
+	ktimer_enqueue(t);
+}
+
+void ktimer_add_ms(struct ktimer *t, u_int ms, void (*fn)(void *), void *arg)
+{
+	ktimer_add(t, ktimer_ms_to_ticks(ms), fn, arg);
+}
+
+// 取消 t，返回 1 表示它原来还挂着
+int ktimer_cancel(struct ktimer *t)
+{
+	if (!t->kt_pending)
+	{
+		return 0;
+	}
+	LIST_REMOVE(t, kt_link);
+	t->kt_pending = 0;
+	ktimer_pending--;
+	return 1;
+}
+
+// 把第 lvl 层第 idx 个槽里的定时器重新插入（都会落到更低的层）
+static void ktimer_cascade(int lvl, u_int idx)
+{
+	struct ktimer *t;
+	while ((t = LIST_FIRST(&kt_wheel[lvl][idx])) != NULL)
+	{
+		LIST_REMOVE(t, kt_link);
+		ktimer_enqueue(t);
+	}
+}
+
+// 每个时钟中断调用一次，真正的处理推迟到 ktimer_run
+void ktimer_tick(void)
+{
+	ktimer_due++;
+	workq_add(&kt_wq, &kt_work);
+}
+
+// 处理 ktimer_now 这个 tick 到期的定时器
+static void ktimer_advance(void)
+{
+	struct ktimer *t;
+	u_int idx = ktimer_now & KT_LVL_MASK;
+	u_int i;
+	int lvl;
+
+	if (idx == 0)
+	{
+		for (lvl = 1; lvl < KT_LEVELS; lvl++)
+		{
+			i = (ktimer_now >> (KT_LVL_BITS * lvl)) & KT_LVL_MASK;
+			ktimer_cascade(lvl, i);
+			if (i != 0)
+			{
+				break;
+			}
+		}
+	}
+
+	// 回调里可能再挂新的定时器（至少一个 tick 之后，不会落回这个槽）
+	while ((t = LIST_FIRST(&kt_wheel[0][idx])) != NULL)
+	{
+		LIST_REMOVE(t, kt_link);
+		t->kt_pending = 0;
+		ktimer_pending--;
+		t->kt_fn(t->kt_arg);
+	}
+	ktimer_now++;
+}
+
+// 推迟的工作：把落下的 tick 逐个补上
+static void ktimer_run(void *arg)
+{
+	while (ktimer_due)
+	{
+		ktimer_due--;
+		ktimer_advance();
+	}
+}
@@ -1,6 +1,10 @@
 #include <inc/printf.h>
 #include <inc/print.h>
 #include <drivers/console.h>
+#include <inc/log.h>
+
+// 各子系统日志的运行期开关，第 LOG_SUB_<子系统> 位为 1 表示输出，见 inc/log.h
+unsigned int log_mask = ~0u;
 
 /**
  * 字符串输出函数（供 lp_Print 调用）
@@ -62,12 +66,15 @@ void printf(char *fmt, ...)
  * fmt 错误信息格式化字符串
  * ... 可变参数
  *
- * 功能：输出错误信息并进入死循环
+ * 功能：切换到同步输出，输出错误信息并进入死循环
  */
 void _panic(const char *file, int line, const char *fmt, ...)
 {
 	va_list ap;
 
+	// 先把发送缓冲区同步发完，之后的输出不再依赖 UART 中断
+	cons_flush_sync();
+
 	// 输出错误位置信息
 	printf("panic at %s:%d: ", file, line);
 
@@ -1,4 +1,6 @@
 #include <inc/rtThread.h>
+#include <inc/log.h>
+#include <inc/env.h>
 #define DEVICE_NUM 10
 
 static struct rt_device device_list[DEVICE_NUM];
@@ -28,15 +30,15 @@ void asid_list_init()
  * @return 客户索引（0 或 1），若无法分配则返回 -1
  *
  * 逻辑：
- * 1. 获取当前任务的 ASID（低 8 位）
- * 2. 查找 asid_list 中是否已有该 ASID
+ * 1. 获取当前任务的 envid
+ * 2. 查找 asid_list 中是否已有该 envid
  *    - 若有，返回对应索引
  *    - 若无，寻找第一个空闲槽位（值为 -1）注册该 ASID 并返回索引
  * 3. 若无空闲槽位（超过 NUMBER_OF_CUSTOMERS），返回 -1
  */
 int getAsidIndex()
 {
-    int temp = 0xff & get_asid(); // 只取 ASID 的低 8 位作为标识
+    int temp = curenv->env_id; // ASID 换代时会变，用 envid 作标识
 
     int i = 0;
     // 先查找是否已存在
@@ -51,7 +53,7 @@ int getAsidIndex()
     {
         if (asid_list[i] == -1)
         {
-            asid_list[i] = temp; // 注册 ASID
+            asid_list[i] = temp; // 注册 envid
             return i;            // 返回新分配的客户索引
         }
     }
@@ -98,9 +100,9 @@ bool rt_require_device(u32 device_id, u32 request_num)
 
     for (u32 n = 0; n < NUMBER_OF_RESOURCES; n++)
     {
-        printf("available before:%d    ", available[n]);
+        kdebug(RT, "available before:%d    ", available[n]);
         available_after_assign[n] = available[n];
-        printf("\n");
+        kdebug(RT, "\n");
     }
 
     for (u32 c = 0; c < NUMBER_OF_CUSTOMERS; c++)
@@ -110,7 +112,7 @@ bool rt_require_device(u32 device_id, u32 request_num)
             tmp[c][d] = need[c][d];
             allocation_after_assign[c][d] = allocation[c][d];
         }
-        printf("\n");
+        kdebug(RT, "\n");
     }
 
     // 初步合法性检查：请求不能超过 need 且不能超过 available
@@ -131,8 +133,8 @@ bool rt_require_device(u32 device_id, u32 request_num)
 
     // 打印模拟后的可用资源（调试用）
     for (u32 n = 0; n < NUMBER_OF_RESOURCES; n++)
-        printf("%d    ", available_after_assign[n]);
-    printf("\n");
+        kdebug(RT, "%d    ", available_after_assign[n]);
+    kdebug(RT, "\n");
 
     // ========== 银行家算法：安全性检查 ==========
     u32 ptr = 0;
@@ -152,7 +154,7 @@ bool rt_require_device(u32 device_id, u32 request_num)
                 // 检查该客户的所有资源需求是否 <= 当前可用资源
                 for (u32 n = 0; n < NUMBER_OF_RESOURCES; n++)
                 {
-                    printf("%d available after assign:%d, tmp:%d \n",
+                    kdebug(RT, "%d available after assign:%d, tmp:%d \n",
                            n, available_after_assign[n], tmp[ptr][n]);
                     if (tmp[ptr][n] > available_after_assign[n])
                     {
@@ -201,18 +203,18 @@ assign:
 exit:
     // 调试输出
     for (u32 n = 0; n < NUMBER_OF_RESOURCES; n++)
-        printf("%d ", request_num);
-    printf("from %d ", customer_num);
+        kdebug(RT, "%d ", request_num);
+    kdebug(RT, "from %d ", customer_num);
 
     if (result)
     {
-        printf("fullfilled\n");
+        kdebug(RT, "fullfilled\n");
         // 调用底层设备驱动的分配函数（如增加引用计数等）
         device_list[device_id].rt_require_device(request_num);
     }
     else
     {
-        printf("denied\n");
+        kdebug(RT, "denied\n");
     }
 
     return result;
@@ -276,7 +278,7 @@ bool rt_device_init(
     {
         available[device_id] = num;   // 初始化可用数量
         all_devices[device_id] = num; // 记录总量
-        printf("%d device has %d items\n", device_id, num);
+        kinfo(RT, "%d device has %d items\n", device_id, num);
     }
 
     nres++; // 增加已注册设备计数
@@ -315,7 +317,7 @@ bool rt_device_read(u32 device_id, char *buf)
 bool rt_claim_device(u32 *require)
 {
     int index = getAsidIndex();
-    printf("%d", index);
+    kdebug(RT, "%d", index);
 
     for (int i = 0; i < NUMBER_OF_RESOURCES; i++)
     {
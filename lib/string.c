@@ -104,19 +104,9 @@ char *strfind(const char *s, char c)
 	return (char *)s;
 }
 
-void *memset(void *v, int c, size_t n)
-{
-	char *p;
-	int m;
-
-	p = v;
-	m = n;
-	while (--m >= 0)
-		*p++ = c;
-
-	return v;
-}
-
+// memcpy/memset/bcopy/bzero 在 string_asm.S 中实现。
+// memcpy 是正向拷贝，dst 不落在 (src, src + n) 内时可以直接交给它；
+// 否则从尾部往回拷，双方字对齐时按字拷贝。
 void *memmove(void *dst, const void *src, size_t n)
 {
 	const char *s;
@@ -124,25 +114,28 @@ void *memmove(void *dst, const void *src, size_t n)
 
 	s = src;
 	d = dst;
-	if (s < d && s + n > d)
+	if (!(s < d && s + n > d))
+		return memcpy(dst, src, n);
+
+	s += n;
+	d += n;
+	if ((((uint32_t)s | (uint32_t)d | n) & 3) == 0)
 	{
-		s += n;
-		d += n;
-		while (n-- > 0)
-			*--d = *--s;
+		while (n > 0)
+		{
+			s -= 4;
+			d -= 4;
+			*(uint32_t *)d = *(const uint32_t *)s;
+			n -= 4;
+		}
 	}
 	else
 		while (n-- > 0)
-			*d++ = *s++;
+			*--d = *--s;
 
 	return dst;
 }
 
-void *memcpy(void *dst, const void *src, size_t n)
-{
-	return memmove(dst, src, n);
-}
-
 int memcmp(const void *v1, const void *v2, size_t n)
 {
 	const uint8_t *s1 = (const uint8_t *)v1;
@@ -1,8 +1,13 @@
 #include <mmu.h>
 #include <env.h>
 #include <printf.h>
+#include <log.h>
 #include <pmap.h>
 #include <sched.h>
+#include <shm.h>
+#include <kstat.h>
+#include <workq.h>
+#include <irq.h>
 #include <print.h>
 #include <../inc/rtThread.h>
 #include <../fs/ff.h>
@@ -10,6 +15,7 @@
 #include <../inc/env.h>
 #include <../inc/string.h>
 #include <../drivers/console.h>
+#include <../drivers/diskio.h>
 #include <../drivers/leds.h>
 #include <../drivers/switches.h>
 #include <../drivers/buzzer.h>
@@ -21,10 +27,7 @@ extern struct Env *curenv;
 char myelf[BUFLEN] = {0};
 char myargv[BUFLEN] = {0};
 
-extern struct Page *create_share_vm(int key, size_t size);
-extern void *insert_share_vm(struct Env *e, struct Page *p);
 extern void env_create_priority_arg(char *binary, int priority, char *arg);
-extern void pthread_create(void *func, int arg);
 extern void readline(const char *prompt, char *ret, int getargv);
 
 /* Overview:
@@ -52,24 +55,37 @@ u_int sys_getenvid(void)
 	return curenv->env_id;
 }
 
-// 共享内存
-void *sys_get_shm(int sysno, int key, int size)
+/* Overview:
+ * 	Attach the shared memory segment named `key` to curenv, creating it with
+ * `size` bytes (rounded up to pages) if it doesn't exist yet. `va` is the
+ * address to attach at, 0 lets the kernel choose. See mm/shm.c.
+ *
+ * Post-Condition:
+ * 	Return the address the segment is attached at, or NULL on error.
+ */
+void *sys_get_shm(int sysno, int key, int size, u_int va)
 {
-	printf("try alloc share mm\n");
-	struct Page *p = NULL;
-	u_long rr;
-	u_long perm;
-	size_t sizeMax = ROUND(size, BY2PG);
-	p = create_share_vm(key, size); // 创建共享内存，详见 mm/pmap.c
-	if (p == NULL)
+	u_long addr;
+	int r;
+
+	if (size < 0 || (r = shm_attach(curenv->env_proc, key, size, va, &addr)) < 0)
 	{
-		printf("alloc shared page failed\n");
+		kerr(SHM, "sys_get_shm:key %d size %d va 0x%x failed\n", key, size, va);
 		return NULL;
 	}
-	printf("alloc shared page success\n");
-	void *result = insert_share_vm(curenv, p); // 共享内存页加入当前虚拟地址中，详见 mm/pmap.c
-	printf("insert shared page success\n");
-	return result;
+	return (void *)addr;
+}
+
+/* Overview:
+ * 	Detach the shared memory segment curenv attached at `va`. The segment is
+ * destroyed when nobody has it attached any more.
+ *
+ * Post-Condition:
+ * 	Return 0 on success, -E_INVAL if nothing is attached at `va`.
+ */
+int sys_shm_detach(int sysno, u_int va)
+{
+	return shm_detach(curenv->env_proc, va);
 }
 
 // 创建进程
@@ -88,15 +104,15 @@ int sys_env_create(int sysno, char *binary, int pt, char *arg)
 			myargv[i] = arg[i];
 		}
 		myargv[i] = 0;
-		printf("\n");
+		kdebug(SYSCALL, "\n");
 		// 把 binary 读到 myelf 里
 		for (i = 0; binary[i]; i++)
 		{
 			myelf[i] = binary[i];
 		}
-		printf("\n");
+		kdebug(SYSCALL, "\n");
 		myelf[i] = 0;
-		printf("env_create_arg(%s, %d, %s)\n", myelf, pt, myargv);
+		kdebug(SYSCALL, "env_create_arg(%s, %d, %s)\n", myelf, pt, myargv);
 		env_create_priority_arg(myelf, pt, myargv);
 	}
 	else
@@ -107,8 +123,8 @@ int sys_env_create(int sysno, char *binary, int pt, char *arg)
 		{
 			myelf[i] = binary[i];
 		}
-		printf("\n");
-		printf("env_create(%s, %d)\n", myelf, pt);
+		kdebug(SYSCALL, "\n");
+		kdebug(SYSCALL, "env_create(%s, %d)\n", myelf, pt);
 		env_create_priority(myelf, pt);
 	}
 }
@@ -132,7 +148,7 @@ int sys_set_pgfault_handler(int sysno, u_int envid, u_int func, u_int xstacktop)
 	ret = envid2env(envid, &env, 0); // 得到 envid 对应的 env
 	if (ret < 0)
 	{
-		printf("sys_set_pgfault_handler:can't get env");
+		kerr(SYSCALL, "sys_set_pgfault_handler:can't get env");
 		return -E_INVAL;
 	}
 	// Your code here.
@@ -170,7 +186,7 @@ int sys_mem_alloc(int sysno, u_int envid, u_int va, u_int perm)
 	if ((!(perm & PTE_V)) || (perm & PTE_COW))
 	{
 		// 按照原注释的意思，判一下 PTE_V PTE_COW
-		printf("sys_mem_alloc:permission denined\n");
+		kerr(SYSCALL, "sys_mem_alloc:permission denined\n");
 		return -E_INVAL;
 	}
 
@@ -178,7 +194,7 @@ int sys_mem_alloc(int sysno, u_int envid, u_int va, u_int perm)
 	else if (va >= UTOP || va < 0)
 	{
 		// va 必须在 0 和 user stack top 之间
-		printf("sys_mem_alloc:va is illegal\n)");
+		kerr(SYSCALL, "sys_mem_alloc:va is illegal\n)");
 		return -E_INVAL;
 	}
 
@@ -186,7 +202,7 @@ int sys_mem_alloc(int sysno, u_int envid, u_int va, u_int perm)
 	ret = page_alloc(&ppage); // 从空闲链表中分配一页物理内存，见 pmap.c
 	if (ret < 0)
 	{
-		printf("sys_mem_alloc:failed to alloc a page\n");
+		kerr(SYSCALL, "sys_mem_alloc:failed to alloc a page\n");
 		return -E_NO_MEM;
 	}
 
@@ -194,7 +210,7 @@ int sys_mem_alloc(int sysno, u_int envid, u_int va, u_int perm)
 	ret = envid2env(envid, &env, 1); // 得到 envid 对应的 env
 	if (ret < 0)
 	{
-		printf("sys_mem_alloc:failed to get the target env\n");
+		kerr(SYSCALL, "sys_mem_alloc:failed to get the target env\n");
 		return -E_BAD_ENV;
 	}
 	// now insert
@@ -202,7 +218,7 @@ int sys_mem_alloc(int sysno, u_int envid, u_int va, u_int perm)
 	// 将 va 虚拟地址、和其要对应的物理页 pp 的映射关系，以 perm 的权限，加入页目录 pde
 	if (ret < 0)
 	{
-		printf("sys_mem_alloc:page_insert failed");
+		kerr(SYSCALL, "sys_mem_alloc:page_insert failed");
 		return -E_NO_MEM;
 	}
 
@@ -241,12 +257,12 @@ int sys_mem_map(int sysno, u_int srcid, u_int srcva, u_int dstid, u_int dstva,
 	// get corresponding env
 	if (envid2env(srcid, &srcenv, 1) < 0) // 如果用 id 找不到 env
 	{									  //=============================
-		printf("sys_mem_map:srcenv doesn't exist\n");
+		kerr(SYSCALL, "sys_mem_map:srcenv doesn't exist\n");
 		return -E_BAD_ENV;
 	}
 	if (envid2env(dstid, &dstenv, 1) < 0) // 如果用 id 找不到 env
 	{									  //==============================
-		printf("sys_mem_map:dstenv doesn't exist\n");
+		kerr(SYSCALL, "sys_mem_map:dstenv doesn't exist\n");
 		return -E_BAD_ENV;
 	}
 
@@ -254,21 +270,25 @@ int sys_mem_map(int sysno, u_int srcid, u_int srcva, u_int dstid, u_int dstva,
 	if (srcva >= UTOP || dstva >= UTOP || srcva < 0 || dstva < 0)
 	{ // 和上面一样，判一下虚拟地址合法性
 		// va 必须在 0 和 user stack top 之间
-		printf("sys_mem_map:va is invalid\n");
+		kerr(SYSCALL, "sys_mem_map:va is invalid\n");
 		return -E_NO_MEM;
 	}
 	// perm is valid?
-	if ((!(perm & PTE_V)) || (perm & PTE_COW))
+	if (!(perm & PTE_V))
 	{ // 和上面一样，判一下 perm 合法性
-		printf("sys_mem_map:permission denied\n");
+		kerr(SYSCALL, "sys_mem_map:permission denied\n");
 		return -E_NO_MEM;
 	}
+	if (perm & PTE_COW)
+	{ // 写时复制映射不能带写权限，第一次写由 handle_mod 复制
+		perm &= ~PTE_R;
+	}
 
 	// try to get the page
 	ppage = page_lookup(srcenv->env_pgdir, round_srcva, &ppte); // 找到虚拟地址 va 所在的页
 	if (ppage == NULL)
 	{
-		printf("sys_mem_map:page of srcva is invalid\n");
+		kerr(SYSCALL, "sys_mem_map:page of srcva is invalid\n");
 		return -E_NO_MEM;
 	}
 
@@ -277,7 +297,7 @@ int sys_mem_map(int sysno, u_int srcid, u_int srcva, u_int dstid, u_int dstva,
 	// 将 va 虚拟地址、和其要对应的物理页 pp 的映射关系，以 perm 的权限，加入页目录 pde
 	if (ret < 0)
 	{
-		printf("sys_mem_map:page_insert denied\n");
+		kerr(SYSCALL, "sys_mem_map:page_insert denied\n");
 		return -E_NO_MEM;
 	}
 
@@ -301,23 +321,135 @@ int sys_mem_unmap(int sysno, u_int envid, u_int va)
 	ret = envid2env(envid, &env, 1); // 照常根据 id 找 env
 	if (ret < 0)
 	{
-		printf("sys_mem_alloc:failed to get the target env\n");
+		kerr(SYSCALL, "sys_mem_alloc:failed to get the target env\n");
 		return -E_BAD_ENV;
 	}
 	if (va < 0 || va >= UTOP)
 	{ // 照常判 va
-		printf("sys_mem_unmap:va is not valid\n");
+		kerr(SYSCALL, "sys_mem_unmap:va is not valid\n");
 		return -E_NO_MEM;
 	}
 	page_remove(env->env_pgdir, va); // 参数为 页目录、va
 	return ret;
 }
 
-// 创建线程
-int sys_pthread_create(int sysno, int *func, int *arg)
+/* Overview:
+ * 	Fork curenv. The child shares every user page copy-on-write (see
+ * env_fork) and returns 0 from this syscall.
+ *
+ * Post-Condition:
+ * 	Return the child's envid to the parent, < 0 on error.
+ */
+int sys_fork(int sysno)
 {
-	pthread_create(func, arg);
-	return 1;
+	struct Env *e;
+	int r;
+	struct Trapframe *tf = (struct Trapframe *)(KERNEL_SP - sizeof(struct Trapframe)); // handle_sys 保存的现场
+
+	if ((r = env_fork(&e, curenv, tf)) < 0)
+	{
+		kerr(SYSCALL, "sys_fork:env_fork failed\n");
+		return r;
+	}
+	sched_insert(e);
+	return e->env_id;
+}
+
+/* Overview:
+ * 	curenv sleeps for at least ms milliseconds. It leaves the run queue
+ * and is put back by its timer on the timer wheel (lib/ktimer.c).
+ * ms == 0 just gives up the CPU.
+ *
+ * Post-Condition:
+ * 	Return 0 after waking up.
+ */
+int sys_sleep_ms(int sysno, u_int ms)
+{
+	if (ms != 0)
+	{
+		sched_sleep(curenv, ms);
+	}
+	sched_block(); // 醒来后从这里接着返回
+	return 0;
+}
+
+/* Overview:
+ * 	Copy the VM counters of envid (0 means curenv) and the global ones,
+ * see inc/vmstat.h, to the user buffer `buf`.
+ *
+ * Post-Condition:
+ * 	Return 0 on success, < 0 on error.
+ */
+int sys_vm_stat(int sysno, u_int envid, struct vm_stat *buf)
+{
+	struct Env *e;
+	struct vm_stat st;
+
+	if (envid2env(envid, &e, 0) < 0)
+	{
+		kerr(SYSCALL, "sys_vm_stat:failed to get the target env\n");
+		return -E_BAD_ENV;
+	}
+	if ((u_int)buf >= UTOP || (u_int)buf + sizeof(st) > UTOP)
+	{
+		kerr(SYSCALL, "sys_vm_stat:buf is not valid\n");
+		return -E_INVAL;
+	}
+	vm_stat_fill(e, &st);
+	bcopy(&st, buf, sizeof(st));
+	return 0;
+}
+
+/* Overview:
+ * 	Print the kernel counters selected by the KSTAT_* bits in `what`, see
+ * inc/kstat.h, on the console. They are meant for tuning and have no fixed
+ * layout, so they are printed here instead of copied out like sys_vm_stat.
+ *
+ * Post-Condition:
+ * 	Return 0.
+ */
+int sys_kstat(int sysno, u_int what)
+{
+	uint32_t hits, misses, dirty;
+
+	if (what & KSTAT_WORKQ)
+	{
+		workq_print_stat();
+	}
+	if (what & KSTAT_DISK)
+	{
+		disk_cache_stat(&hits, &misses, &dirty);
+		printf("disk cache: %d hits, %d misses, %d dirty\n", hits, misses, dirty);
+	}
+	if (what & KSTAT_IRQ)
+	{
+		irq_print_stat();
+	}
+	if (what & KSTAT_CONS)
+	{
+		cons_print_stat();
+	}
+	return 0;
+}
+
+/* Overview:
+ * 	Create a thread of curenv's process running func(arg), see thread_create.
+ *
+ * Post-Condition:
+ * 	Return the thread's envid on success, -E_NO_FREE_ENV if there is no free
+ * 	env or thread stack slot left.
+ */
+int sys_pthread_create(int sysno, void *func, int arg)
+{
+	struct Trapframe *tf = (struct Trapframe *)(KERNEL_SP - sizeof(struct Trapframe)); // handle_sys 保存的现场
+	struct Env *e;
+	int r;
+
+	if ((r = thread_create(&e, func, arg, tf)) < 0)
+	{
+		return r;
+	}
+	return e->env_id;
 }
 
 /* Overview:
@@ -348,13 +480,13 @@ int sys_set_env_status(int sysno, u_int envid, u_int status)
 	// 判合法性
 	if (status != ENV_RUNNABLE && status != ENV_NOT_RUNNABLE && status != ENV_FREE && status != ENV_SUSPEND && status != dying)
 	{ // 判一下 status 合法性
-		printf("set_env_status:wrong status");
+		kerr(SYSCALL, "set_env_status:wrong status");
 		return -E_INVAL;
 	}
 	r = envid2env(envid, &env, 0); // 照常找 env
 	if (r < 0)
 	{
-		printf("set_status:env is invalid\n");
+		kerr(SYSCALL, "set_status:env is invalid\n");
 		return -E_BAD_ENV;
 	}
 
@@ -364,35 +496,12 @@ int sys_set_env_status(int sysno, u_int envid, u_int status)
 	if (status == ENV_FREE && env->env_status != status)
 	{
 
-		// 1. 从 env_runnable 里删去 env
-		bool Efound = true;
-		struct Env *tempE = env_runnable_head;
-		struct Env *tempE_pre = env_runnable_tail;
-		while (tempE != env)
-		{
-			tempE_pre = tempE;
-			tempE = tempE->env_link;
-			if (tempE == env_runnable_head)
-			{					// 回到起点
-				Efound = false; // 没找到
-			}
-		}
-		if (Efound)
-		{ // 现在我们找到了 env，tempE 指向 env，tempE_pre 是 env 前一个
-			if (tempE == env_runnable_tail)
-			{
-				env_runnable_tail = tempE_pre;
-			}
-			if (env_runnable_head == env)
-			{
-				env_runnable_head = env_runnable_head->env_link;
-			}
-			tempE_pre->env_link = tempE->env_link; // 从 env_runnable 里删去 env
-		}
+		// 1. 从运行队列里删去 env
+		sched_remove(env);
 
 		// 2. 把 env 加入 env_free_list
-		Efound = false;
-		tempE = env_free_list;
+		bool Efound = false;
+		struct Env *tempE = env_free_list;
 		while (tempE != NULL)
 		{
 			if (tempE == env)
@@ -412,29 +521,13 @@ int sys_set_env_status(int sysno, u_int envid, u_int status)
 	else if (status == ENV_RUNNABLE && env->env_status != status)
 	{
 
-		// 1. 把 env 加入 env_runnable
-		bool Efound = true;
-		struct Env *tempE = env_runnable_head;
-		struct Env *tempE_pre = env_runnable_tail;
-		while (tempE != env)
-		{
-			tempE = tempE->env_link;
-			if (tempE == env_runnable_head)
-			{					// 回到起点
-				Efound = false; // 没找到
-			}
-		}
-		if (!Efound)
-		{									   // 把 env 加入 env_runnable
-			env->env_link = env_runnable_head; // env 指向 env_runnable_list 链表头
-			env_runnable_head = env;		   // 把新的链表头赋为 env
-			env_runnable_tail->env_link = env;
-		}
+		// 1. 把 env 加入运行队列
+		sched_insert(env);
 
 		// 2. 从 env_free_list 里删去 env
-		Efound = false;
-		tempE = env_free_list;
-		tempE_pre = NULL;
+		bool Efound = false;
+		struct Env *tempE = env_free_list;
+		struct Env *tempE_pre = NULL;
 		while (tempE != NULL)
 		{
 			if (tempE == env)
@@ -454,36 +547,13 @@ int sys_set_env_status(int sysno, u_int envid, u_int status)
 	else if (status == ENV_NOT_RUNNABLE && env->env_status != status)
 	{
 
-		// 1. 从 env_runnable 里删去 env
-		bool Efound = true;
-		struct Env *tempE = env_runnable_head;
-		struct Env *tempE_pre = env_runnable_tail;
-		while (tempE != env)
-		{
-			tempE_pre = tempE;
-			tempE = tempE->env_link;
-			if (tempE == env_runnable_head)
-			{					// 回到起点
-				Efound = false; // 没找到
-			}
-		}
-		if (Efound)
-		{ // 现在我们找到了 env，tempE 指向 env，tempE_pre 是 env 前一个
-			if (tempE == env_runnable_tail)
-			{
-				env_runnable_tail = tempE_pre;
-			}
-			if (env_runnable_head == env)
-			{
-				env_runnable_head = env_runnable_head->env_link;
-			}
-			tempE_pre->env_link = tempE->env_link; // 从 env_runnable 里删去e
-		}
+		// 1. 从运行队列里删去 env
+		sched_remove(env);
 
 		// 2. 从 env_free_list 里删去 env
-		Efound = false;
-		tempE = env_free_list;
-		tempE_pre = NULL;
+		bool Efound = false;
+		struct Env *tempE = env_free_list;
+		struct Env *tempE_pre = NULL;
 		while (tempE != NULL)
 		{
 			if (tempE == env)
@@ -523,7 +593,7 @@ int sys_set_trapframe(int sysno, u_int envid, struct Trapframe *tf)
 	ret = envid2env(envid, &e, 1); // 继续找 env
 	if (ret < 0)
 	{
-		printf("set_trapframe:env is invalid\n");
+		kerr(SYSCALL, "set_trapframe:env is invalid\n");
 		return -E_BAD_ENV;
 	}
 	e->env_tf = *tf; // 设置进程上下文, 直接指向
@@ -593,19 +663,19 @@ int sys_ipc_can_send(int sysno, u_int envid, u_int value, u_int srcva,
 	r = envid2env(envid, &e, 0); // 找到 target env
 	if (r < 0)
 	{
-		printf("ipc_send:dstenv is invalid\n");
+		kerr(SYSCALL, "ipc_send:dstenv is invalid\n");
 		return -E_BAD_ENV;
 	}
 	// check whether target env is requesting ipc
 	if (e->env_status != ENV_NOT_RUNNABLE || !e->env_ipc_recving)
 	{ // 判一下 target env 的状态，是否是等待收到信息
-		printf("ipc_send:target env id not requesting recving\n");
+		kerr(SYSCALL, "ipc_send:target env id not requesting recving\n");
 		return -E_IPC_NOT_RECV;
 	}
 	// check whether source & target virtual address is valid
 	if (srcva >= UTOP || srcva < 0)
 	{ // 判一下虚拟地址 va 合法性
-		printf("ipc_send:virtual address greater than UTOP\n");
+		kerr(SYSCALL, "ipc_send:virtual address greater than UTOP\n");
 		return -E_NO_MEM;
 	}
 	// try to get the page which will be sent later
@@ -614,13 +684,13 @@ int sys_ipc_can_send(int sysno, u_int envid, u_int value, u_int srcva,
 		p = page_lookup(curenv->env_pgdir, srcva, &ppte);
 		if (p == NULL)
 		{ // 找到要收信息的那个物理页
-			printf("ipc_send:destinated page not exist");
+			kerr(SYSCALL, "ipc_send:destinated page not exist");
 			return -E_NO_MEM;
 		}
 		r = page_insert(e->env_pgdir, p, e->env_ipc_dstva, perm);
 		if (r < 0)
 		{
-			printf("ipc_send:page_insert failed\n");
+			kerr(SYSCALL, "ipc_send:page_insert failed\n");
 			return -E_NO_MEM;
 		}
 	}
@@ -633,29 +703,13 @@ int sys_ipc_can_send(int sysno, u_int envid, u_int value, u_int srcva,
 	e->env_status = ENV_RUNNABLE;
 	if (true)
 	{
-		// 1. 把 e 加入 env_runnable
-		bool Efound = true;
-		struct Env *tempE = env_runnable_head;
-		struct Env *tempE_pre = env_runnable_tail;
-		while (tempE != e)
-		{
-			tempE = tempE->env_link;
-			if (tempE == env_runnable_head)
-			{					// 回到起点
-				Efound = false; // 没找到
-			}
-		}
-		if (!Efound)
-		{									 // 把 e 加入 env_runnable
-			e->env_link = env_runnable_head; // e 指向 env_runnable_list 链表头
-			env_runnable_head = e;			 // 把新的链表头赋为 e
-			env_runnable_tail->env_link = e;
-		}
+		// 1. 把 e 加入运行队列
+		sched_insert(e);
 
 		// 2. 从 env_free_list 里删去 e
-		Efound = false;
-		tempE = env_free_list;
-		tempE_pre = NULL;
+		bool Efound = false;
+		struct Env *tempE = env_free_list;
+		struct Env *tempE_pre = NULL;
 		while (tempE != NULL)
 		{
 			if (tempE == e)
@@ -690,45 +744,21 @@ int sys_ipc_can_send(int sysno, u_int envid, u_int value, u_int srcva,
 // 由 curenv 调用，表示自己希望接收别的进程的通信
 void sys_ipc_recv(int sysno, u_int dstva)
 {
-	extern int remaining_time;
 	if (dstva >= UTOP || dstva < 0)
 	{ // 判虚拟地址是否合法
-		printf("ipc_recv:dstva is greater than UTOP");
+		kerr(SYSCALL, "ipc_recv:dstva is greater than UTOP");
 		return;
 	}
 	curenv->env_status = ENV_NOT_RUNNABLE;
 	if (true)
 	{
-		// 1. 从 env_runnable 里删去 curenv
-		bool Efound = true;
-		struct Env *tempE = env_runnable_head;
-		struct Env *tempE_pre = env_runnable_tail;
-		while (tempE != curenv)
-		{
-			tempE_pre = tempE;
-			tempE = tempE->env_link;
-			if (tempE == env_runnable_head)
-			{					// 回到起点
-				Efound = false; // 没找到
-			}
-		}
-		if (Efound)
-		{ // 现在我们找到了 env，tempE 指向 env，tempE_pre 是 curenv 前一个
-			if (tempE == env_runnable_tail)
-			{
-				env_runnable_tail = tempE_pre;
-			}
-			if (env_runnable_head == curenv)
-			{
-				env_runnable_head = env_runnable_head->env_link;
-			}
-			tempE_pre->env_link = tempE->env_link; // 从 env_runnable 里删去e
-		}
+		// 1. 从运行队列里删去 curenv
+		sched_remove(curenv);
 
 		// 2. 从 env_free_list 里删去 curenv
-		Efound = false;
-		tempE = env_free_list;
-		tempE_pre = NULL;
+		bool Efound = false;
+		struct Env *tempE = env_free_list;
+		struct Env *tempE_pre = NULL;
 		while (tempE != NULL)
 		{
 			if (tempE == curenv)
@@ -747,15 +777,11 @@ void sys_ipc_recv(int sysno, u_int dstva)
 	curenv->env_ipc_recving = 1;
 	curenv->env_ipc_dstva = dstva;
 
-	remaining_time = 0;
-	void *src = KERNEL_SP - sizeof(struct Trapframe);
-	void *dst = TIMESTACK - sizeof(struct Trapframe);
-	bcopy(src, dst, sizeof(struct Trapframe)); // bit copy
-	sched_yield();
-	// sched_yield_voluntarily_giveup();
+	// 在自己的内核栈上阻塞，sys_ipc_can_send 把它放回运行队列后从这里返回
+	sched_block();
 }
 
-// 释放自己, 目前直接调用 env_free(), 由于 tlb_invalidate 接口问题只能接受 curenv
+// 释放自己，直接调用 env_free()
 void sys_free_myself()
 {
 	env_free(curenv);
@@ -796,7 +822,7 @@ int sys_write_dev(int sysno, u_int va, u_int dev, u_int len)
 		  (dev >= 0x13000000 && endaddr <= 0x13000000 + 0x4200) ||
 		  (dev >= 0x15000000 && endaddr <= 0x15000000 + 0x200)))
 	{ // 判 dev 地址合法性
-		printf("sys_write_dev:invalid dev\n");
+		kerr(SYSCALL, "sys_write_dev:invalid dev\n");
 		return -E_INVAL;
 	}
 	startaddr += 0xa0000000;				   // 直接虚拟地址 -> 物理地址
@@ -830,7 +856,7 @@ int sys_read_dev(int sysno, u_int va, u_int dev, u_int len)
 		  (dev >= 0x13000000 && endaddr <= 0x13000000 + 0x4200) ||
 		  (dev >= 0x15000000 && endaddr <= 0x15000000 + 0x200)))
 	{ // 判 dev 地址合法性
-		printf("sys_read_dev:invalid dev\n");
+		kerr(SYSCALL, "sys_read_dev:invalid dev\n");
 		return -E_INVAL;
 	}
 	startaddr += 0xa0000000;				   // 直接虚拟地址 -> 物理地址
@@ -869,9 +895,9 @@ void sys_readline(int sysno, const char *prompt, char *ret, int getargv)
 }
 
 extern int cur_sched;
-void sys_env_create_1(int sysno, void *func, int arg)
+int sys_env_create_1(int sysno, void *func, int arg)
 {
-	pthread_create(func, arg);
+	return sys_pthread_create(sysno, func, arg);
 }
 
 int sys_mkdir(int sysno, char *path)
@@ -0,0 +1,120 @@
+#include <workq.h>
+#include <error.h>
+#include <mmu.h>
+#include <printf.h>
+#include <mips/cpu.h>
+
+static struct workq *workq_list;
+static struct workq **workq_last = &workq_list;
+static int workq_running; // 工作函数里又走到 workq_run 时不重入
+
+// 把 q 清空并挂到 workq_run 的处理列表末尾，每个队列只调一次
+void workq_init(struct workq *q, const char *name)
+{
+	bzero(q, sizeof(*q));
+	q->wq_name = name;
+	*workq_last = q;
+	workq_last = &q->wq_next;
+}
+
+/* Overview:
+ *  Queue w on q to run at the next workq_run. Safe from interrupt handlers
+ *  and from kernel code running with EXL=1; neither takes a lock.
+ *
+ * Post-Condition:
+ *  Return 0 if w is queued, including when it already was. Return -E_NO_MEM
+ *  if q is full; w is not queued and wq_dropped is bumped.
+ */
+int workq_add(struct workq *q, struct work *w)
+{
+	u_int tail = q->wq_tail;
+	u_int depth = tail - q->wq_head;
+
+	if (w->w_pending)
+	{
+		return 0;
+	}
+	if (depth >= WQ_SIZE)
+	{
+		q->wq_dropped++;
+		return -E_NO_MEM;
+	}
+	w->w_pending = 1;
+	w->w_stamp = mips32_getcount();
+	q->wq_ring[tail % WQ_SIZE] = w;
+	_mips_sync(); // 槽写好了再推进 tail
+	q->wq_tail = tail + 1;
+	q->wq_added++;
+	if (depth + 1 > q->wq_depth_max)
+	{
+		q->wq_depth_max = depth + 1;
+	}
+	return 0;
+}
+
+/*
+ * 只执行进来时已经在队列里的工作，工作函数再入队的留到下一次，
+ * 自己给自己续期的工作也不会让这里转不出去。
+ */
+static void workq_drain(struct workq *q)
+{
+	u_int end = q->wq_tail;
+	struct work *w;
+	u_int lat;
+
+	while (q->wq_head != end)
+	{
+		w = q->wq_ring[q->wq_head % WQ_SIZE];
+		_mips_sync(); // 槽读出来了再推进 head
+		q->wq_head++;
+		lat = mips32_getcount() - w->w_stamp;
+		if (lat > q->wq_lat_max)
+		{
+			q->wq_lat_max = lat;
+		}
+		q->wq_lat_avg += ((int)lat - (int)q->wq_lat_avg) / 8;
+		w->w_pending = 0; // 先清，工作函数里可以把自己再挂上
+		w->w_fn(w->w_arg);
+		q->wq_done++;
+	}
+}
+
+// 按 workq_init 的先后把所有队列各跑一遍，调用者保证 EXL=1
+void workq_run(void)
+{
+	struct workq *q;
+
+	if (workq_running)
+	{
+		return;
+	}
+	workq_running = 1;
+	for (q = workq_list; q; q = q->wq_next)
+	{
+		if (q->wq_head != q->wq_tail)
+		{
+			workq_drain(q);
+		}
+	}
+	workq_running = 0;
+}
+
+// 空闲循环开着中断（EXL=0），置上 EXL 再跑，跑完再放开
+void workq_run_idle(void)
+{
+	mips32_bissr(SR_EXL);
+	workq_run();
+	mips32_bicsr(SR_EXL);
+}
+
+void workq_print_stat(void)
+{
+	struct workq *q;
+
+	for (q = workq_list; q; q = q->wq_next)
+	{
+		printf("workq %s: depth %d (max %d), %d added, %d done, %d dropped\n", q->wq_name,
+			   q->wq_tail - q->wq_head, q->wq_depth_max, q->wq_added, q->wq_done, q->wq_dropped);
+		printf("  latency: avg %d, max %d counts\n", q->wq_lat_avg, q->wq_lat_max);
+	}
+}
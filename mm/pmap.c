@@ -6,35 +6,51 @@
 #include <pmap.h>
 #include <error.h>
 #include <tlbop.h>
-#include <hash.h>
+#include <log.h>
 
 /* These variables are set by set_physic_mm() */
 u_long maxpa;   /* Maximum physical address */
 u_long npage;   /* Amount of memory(in pages) */
 u_long basemem; /* Amount of base memory(in bytes) */
 u_long extmem;  /* Amount of extended memory(in bytes) */
-u_long tlbCount=0;
 Pde *boot_pgdir;
-#define maxTLB 16
 struct Page *pages;
 static u_long freemem;
 
-/* 变量 page_free_list 来以链表的形式表示所有的空闲物理内存 */
-static struct FreePageList page_free_list; /* Free list of physical pages */
-struct HashTable ht;
-
-/* 获取下一个可用的TLB条目索引，循环使用TLB */
-u_long getNextTlb()//要写的下一个tlb
+/* buddy 分配器：free_area[k] 以链表的形式记录所有阶为 k 的空闲块（只挂头页） */
+static struct FreeArea
 {
-    printf("nexttlb:%d\n",tlbCount);
-    // 返回当前TLB索引，并将索引递增，使用取模实现循环
-    u_long result = tlbCount;
-    tlbCount = (tlbCount + 1) % maxTLB;
-    return result;
-}
-
-
-
+    struct FreePageList free_list; /* Free list of 2^k-page blocks */
+    u_long nr_free;                /* Number of blocks on free_list */
+} free_area[PAGE_MAX_ORDER + 1];
+
+/* 预先清零的空闲页池：空闲循环里调用 page_zero_refill 补充，page_alloc 优先从这里取 */
+#define PAGE_ZERO_POOL_MAX 64
+static struct FreePageList page_zero_pool;
+static u_int page_zero_pool_cnt;
+static u_long page_zero_hits;   // page_alloc 直接从池中取到已清零页的次数
+static u_long page_zero_misses; // 池为空、只能当场清零的次数
+
+u_int tlb_size;           // TLB 项数，tlb_init 从 Config1 读出
+u_int tlb_nwired;         // CP0 Wired，[0, tlb_nwired) 是固定项
+u_long tlb_refills;       // genex.S 快速路径的重填次数
+u_long tlb_refills_slow;  // tlb_refill 慢速路径的次数
+u_long tlb_evictions;     // 快速路径换掉有效项的次数，只在 TLB_STATS 下统计
+u_long tlb_wired_writes;  // tlb_wire_env 写固定项的次数
+u_long tlb_sweeps;        // tlb_sweep 整体扫描 TLB 的次数
+u_long tlb_refills_large; // 写成大页项的重填次数（算在 tlb_refills_slow 里）
+u_long tlb_refill_hi;     // TLB_STATS 下快速路径暂存 EntryHi
+static u_long tlb_refills_charged; // tlb_refills 中已经记到进程头上的部分
+
+static void page_demote(Pde *pgdir, u_long va, Pte pte);
+static void tlb_invalidate_span(Pde *pgdir, u_long start, u_long end);
+
+/* 全局虚存计数，见 inc/vmstat.h；进程各自的计数在 env_vm 里 */
+u_long vm_pageouts;
+u_long vm_cow_faults;
+u_long vm_pages_mapped;
+u_long vm_pt_pages;
+u_long page_alloc_failures;
 
 /********************* Private Functions *********************/
 // transfer page to page number
@@ -104,7 +120,7 @@ u_long
 va2pa_print(Pde *pgdir, u_long va)//查页表，有则返回，无则返回全1
 {
     Pte *p;
-    printf("\n@@@ tlb-va2pa: 0x%x   epc：0x%x\n",va,get_epc());
+    kdebug(MM, "\n@@@ tlb-va2pa: 0x%x   epc：0x%x\n",va,get_epc());
 
     pgdir = &pgdir[PDX(va)];
     if (!(*pgdir & PTE_V))   //一级页表没找到
@@ -116,21 +132,21 @@ va2pa_print(Pde *pgdir, u_long va)//查页表，有则返回，无则返回全1
     {
         return ~0;
     }
-    printf("tlb_va_found!\n", va);
+    kdebug(MM, "tlb_va_found!\n", va);
     return PTE_ADDR(p[PTX(va)]) | (va & 0xFFF);
 }
 
 void print_illegal(int num)
 {
-    printf("illegal syscall num :%d ,epc: 0x%x\n",num/4,get_epc());
+    kerr(SYSCALL, "illegal syscall num :%d ,epc: 0x%x\n",num/4,get_epc());
     while(1);
 }
 
 // env释放
 void print_addr_error()
 {
-    printf("\n### addr exception (see manual p120)###\n");
-    printf("### epc：0x%x  badaddr: 0x%x status: 0x%x\n",get_epc(),get_badaddr(),get_status());
+    kerr(MM, "\n### addr exception (see manual p120)###\n");
+    kerr(MM, "### epc：0x%x  badaddr: 0x%x status: 0x%x\n",get_epc(),get_badaddr(),get_status());
     // while(1);
     env_free(curenv);
 
@@ -154,8 +170,8 @@ void set_physic_mm()
     /* Step 2: Calculate corresponding npage value. */
     npage = maxpa / BY2PG; // Amount of pages equal to maximum physical address divided by page size (4KB)
     extmem = 0;            // In our platform there is no extended memory
-    printf("Physical memory: %dK available, ", (int)(maxpa / 1024));
-    printf("base = %dK, extended = %dK\n", (int)(basemem / 1024), (int)(extmem / 1024));
+    kinfo(MM, "Physical memory: %dK available, ", (int)(maxpa / 1024));
+    kinfo(MM, "base = %dK, extended = %dK\n", (int)(basemem / 1024), (int)(extmem / 1024));
 }
 
 /**
@@ -265,8 +281,11 @@ static Pte *boot_pgdir_walk(Pde *pgdir, u_long va, int create)
  *      Map [va, va+size) of virtual address space to physical [pa, pa+size) in the page table rooted at pgdir.
  *      Use permission bits `perm|PTE_V` for the entries.
  *      Use permission bits `perm` for the entries.
+ *      With a page size in `perm` (PTE_64K/PTE_1M/PTE_16M) the segment is
+ *      mapped with large pages, see inc/mmu.h.
  * Pre-Condition:
- *      Size is a multiple of BY2PG.
+ *      Size is a multiple of BY2PG; for large pages va, pa and size are all
+ *      multiples of the page size.
  */
 void boot_map_segment(Pde *pgdir, u_long va, u_long size, u_long pa, int perm)
 {
@@ -279,6 +298,10 @@ void boot_map_segment(Pde *pgdir, u_long va, u_long size, u_long pa, int perm)
     {
         panic("pmap.c :134:size not aligned");
     }
+    if ((perm & PTE_PGSZ) && ((va | pa | size) & (PTE_PGSIZE(perm) - 1)))
+    {
+        panic("boot_map_segment: large page not aligned");
+    }
 
     /* Step 2: Map virtual address space to physical address. */
     /* Hint: Use `boot_pgdir_walk` to get the page table entry of virtual address `va`. */
@@ -316,7 +339,7 @@ void vm_init()
     /* Step 1: Allocate a page for page directory(first level page table). */
     // 分配一页内存作为一级页表（页目录），并清零
     pgdir = alloc(BY2PG, BY2PG, 1);// 内核的一级页表！！！！
-    printf("to memory %x for struct page directory. \n", pgdir);
+    kinfo(MM, "to memory %x for struct page directory. \n", pgdir);
     mCONTEXT = (int)pgdir;
     boot_pgdir = pgdir;
     /**
@@ -327,7 +350,7 @@ void vm_init()
      */
     // 为pages数组分配内存，每个物理页对应一个Page结构体
     pages = (struct Page *)alloc(npage * sizeof(struct Page), BY2PG, 1); // 给每个 物理 页的管理信息创建内存
-    printf("to memory %x for struct Pages.\n", pages);
+    kinfo(MM, "to memory %x for struct Pages.\n", pages);
     // 计算pages数组的大小，向上对齐到页大小
     n = ROUND(npage * sizeof(struct Page), BY2PG);
     // 将UPAGES虚拟地址映射到pages物理地址
@@ -339,32 +362,53 @@ void vm_init()
      */
     // 为envs数组分配内存，每个进程对应一个Env结构体
     envs = (struct Env *)alloc(NENV * sizeof(struct Env), BY2PG, 1);
-    printf("to memory %x for struct Pages.\n", envs);
+    kinfo(MM, "to memory %x for struct Pages.\n", envs);
     // 计算envs数组的大小，向上对齐到页大小
     n = ROUND(NENV * sizeof(struct Env), BY2PG);
     // 将UENVS虚拟地址映射到envs物理地址
     boot_map_segment(pgdir, UENVS, n, PADDR(envs), PTE_R);
-    printf("mips_vm_init:boot_pgdir is %x\n", boot_pgdir);
-    printf("pmap.c:\t mips vm init success\n");
+    kinfo(MM, "mips_vm_init:boot_pgdir is %x\n", boot_pgdir);
+    kinfo(MM, "pmap.c:\t mips vm init success\n");
+}
+
+/* 把以 pp 为头页、阶为 order 的块挂到空闲链表上 */
+static void free_area_add(struct Page *pp, u_int order)
+{
+    pp->pp_flags |= PP_FREE;
+    pp->pp_order = order;
+    LIST_INSERT_HEAD(&free_area[order].free_list, pp, pp_link);
+    free_area[order].nr_free++;
+}
+
+/* 把空闲块 pp 从它所在的空闲链表上摘下 */
+static void free_area_del(struct Page *pp)
+{
+    LIST_REMOVE(pp, pp_link);
+    free_area[pp->pp_order].nr_free--;
+    pp->pp_flags &= ~PP_FREE;
 }
 
 /**
- * page_init 函数，使用 inc/queue.h 中定义的宏函数将未分配
- * 的物理页加入到空闲链表 page_free_list 中去
+ * page_init 函数，把未分配的物理页按尽量大的对齐块加入 buddy 分配器的空闲链表
  * Overview:
- *     Initialize page structure and memory free list.
+ *     Initialize page structure and memory free lists.
  *     The `pages` array has one `struct Page` entry per physical page. Pages
- *     are reference counted, and free pages are kept on a linked list.
- *
- *     Use `LIST_INSERT_HEAD` to insert something to list.
+ *     are reference counted, and free pages are kept in power-of-two blocks
+ *     on the per-order lists in `free_area`.
  */
 void page_init(void)
 {
-    int i = 0;
-    /* Step 1: Initialize page_free_list. */
-    /* Hint: Use macro `LIST_INIT` defined in include/queue.h. */
-    // 初始化空闲页链表为空
-    LIST_INIT(&page_free_list);
+    u_long i = 0;
+    u_int order;
+    /* Step 1: Initialize free_area. */
+    // 初始化每一阶的空闲链表为空
+    for (order = 0; order <= PAGE_MAX_ORDER; order++)
+    {
+        LIST_INIT(&free_area[order].free_list);
+        free_area[order].nr_free = 0;
+    }
+    LIST_INIT(&page_zero_pool);
+    page_zero_pool_cnt = 0;
 
     /* Step 2: Align `freemem` up to multiple of BY2PG. */
     // 将freemem向上对齐到页边界
@@ -376,134 +420,253 @@ void page_init(void)
     for (i = 0; i < PPN(PADDR((void *)freemem)); i++)
     {
         pages[i].pp_ref = 1;  // 引用计数设为1，表示已被使用
+        pages[i].pp_flags = 0;
     }
 
     /* Step 4: Mark the other memory as free. */
-    // 将freemem以上的内存标记为空闲，加入空闲链表
+    // 将freemem以上的内存标记为空闲，每次取从 i 开始、按自身大小对齐且不越界的最大块
     for (; i < npage; i++)
     {
         pages[i].pp_ref = 0;  // 引用计数设为0，表示空闲
-        LIST_INSERT_HEAD(&page_free_list, &pages[i], pp_link);
+        pages[i].pp_flags = 0;
+    }
+    for (i = PPN(PADDR((void *)freemem)); i < npage; i += 1 << order)
+    {
+        order = PAGE_MAX_ORDER;
+        while ((i & ((1 << order) - 1)) || i + (1 << order) > npage)
+        {
+            order--;
+        }
+        free_area_add(&pages[i], order);
+    }
+}
+
+/* 从 buddy 分配器中取一个阶为 order 的块，不清零；没有足够大的空闲块时返回 NULL */
+static struct Page *buddy_alloc(u_int order)
+{
+    struct Page *ppage_temp;
+    u_int k;
+
+    /* Step 1: Find the smallest non-empty free list that fits. */
+    for (k = order; k <= PAGE_MAX_ORDER; k++)
+    {
+        if (!LIST_EMPTY(&free_area[k].free_list))
+        {
+            break;
+        }
+    }
+    if (k > PAGE_MAX_ORDER)
+    {
+        return NULL;
+    }
+
+    /* Step 2: Take the block off its list and split it down to `order`. */
+    ppage_temp = LIST_FIRST(&free_area[k].free_list);
+    free_area_del(ppage_temp);
+    while (k > order)
+    {
+        k--;
+        free_area_add(ppage_temp + (1 << k), k); // 后一半作为伙伴放回空闲链表
+    }
+    return ppage_temp;
+}
+
+/* 把预清零池里的页全部还给 buddy 分配器，好和伙伴合并成大块 */
+static void page_zero_drain(void)
+{
+    struct Page *ppage_temp;
+
+    while (!LIST_EMPTY(&page_zero_pool))
+    {
+        ppage_temp = LIST_FIRST(&page_zero_pool);
+        LIST_REMOVE(ppage_temp, pp_link);
+        page_free_order(ppage_temp, 0);
+    }
+    page_zero_pool_cnt = 0;
+}
+
+/**
+ * Overview:
+ *     Same as page_alloc_order, but the block is NOT cleared. Only for
+ *     callers that overwrite the block, or the part of it they use, before
+ *     anyone reads it. If no free block is big enough, the pre-zeroed pool
+ *     is given back to the buddy allocator first and the allocation retried:
+ *     pages parked there cannot coalesce, which can leave a large request
+ *     failing while enough free memory exists.
+ * Post-Condition:
+ *     If there's no free block big enough, return -E_NO_MEM.
+ *     Else, set the first page of the block to *pp, and returned 0.
+ */
+int page_alloc_order_nozero(struct Page **pp, u_int order)
+{
+    struct Page *ppage_temp;
+
+    if (order > PAGE_MAX_ORDER)
+    {
+        return -E_INVAL;
+    }
+    if ((ppage_temp = buddy_alloc(order)) == NULL && page_zero_pool_cnt > 0)
+    {
+        page_zero_drain();
+        ppage_temp = buddy_alloc(order);
+    }
+    if (ppage_temp == NULL)
+    {
+        page_alloc_failures++;
+        return -E_NO_MEM;  // 没有足够大的空闲块，返回内存不足错误
     }
+
+    *pp = ppage_temp;
+    return 0;
 }
 
 /**
- * page_alloc 函数用来从空闲链表中分配一页物理内存
+ * page_alloc_order 函数从 buddy 分配器中分配 2^order 个物理地址连续的页
+ * Overview:
+ *     Allocates a block of 2^`order` contiguous physical pages, aligned to its
+ *     own size, and clear it. Larger free blocks are split in half until the
+ *     requested order is reached; the unused halves go back to the free lists.
+ * Post-Condition:
+ *     If there's no free block big enough, return -E_NO_MEM.
+ *     Else, set the first page of the block to *pp, and returned 0.
+ * Note:
+ *     Does NOT increment the reference count of any page. Pages of the block
+ *     may be released one by one with page_free, or all at once with
+ *     page_free_order.
+ */
+int page_alloc_order(struct Page **pp, u_int order)
+{
+    int r;
+
+    if ((r = page_alloc_order_nozero(pp, order)) < 0)
+    {
+        return r;
+    }
+
+    bzero((void *)page2kva(*pp), BY2PG << order); // 清零分配的块
+    return 0;
+}
+
+/**
+ * page_alloc 函数用来从空闲内存中分配一页物理内存
  * Overview:
  *     Allocates a physical page from free memory, and clear this page.
+ *     A page already zeroed by page_zero_refill is used when there is one.
  * Post-Condition:
  *     If failed to allocate a new page(out of memory(there's no free page)), return -E_NO_MEM.
  *     Else, set the address of allocated page to *pp, and returned 0.
  * Note:
  *     Does NOT increment the reference count of the page - the caller must do
  *     these if necessary (either explicitly or via page_insert).
- *
- *     Use LIST_FIRST and LIST_REMOVE defined in include/queue.h .
  */
 int page_alloc(struct Page **pp)
 {
-    struct Page *ppage_temp;
-    /* Step 1: Get a page from free memory. If fails, return the error code.*/
-    // 检查空闲链表是否为空
-    if (LIST_EMPTY(&page_free_list))
+    if (!LIST_EMPTY(&page_zero_pool))
     {
-        return -E_NO_MEM;  // 没有空闲页，返回内存不足错误
+        *pp = LIST_FIRST(&page_zero_pool);
+        LIST_REMOVE(*pp, pp_link);
+        page_zero_pool_cnt--;
+        page_zero_hits++;
+        return 0;
     }
+    page_zero_misses++;
+    return page_alloc_order(pp, 0);
+}
 
-    /**
-     * Step 2: Initialize this page.
-     *  use `bzero`.
-     */
-    *pp = LIST_FIRST(&page_free_list);                 //get and turn for the *pp
-    bzero((void *)page2kva(*pp), BY2PG);               // bzero *pp 清零分配的页
-    LIST_REMOVE(*pp, pp_link);                         //remove allocted page from free_list.
+/**
+ * Overview:
+ *     Same as page_alloc, but the page is NOT cleared. Only for callers that
+ *     overwrite the whole page. Takes from the buddy allocator first so that
+ *     pre-zeroed pages are left for page_alloc.
+ */
+int page_alloc_nozero(struct Page **pp)
+{
+    struct Page *ppage_temp = buddy_alloc(0);
+
+    if (ppage_temp == NULL)
+    {
+        if (LIST_EMPTY(&page_zero_pool))
+        {
+            page_alloc_failures++;
+            return -E_NO_MEM;
+        }
+        ppage_temp = LIST_FIRST(&page_zero_pool);
+        LIST_REMOVE(ppage_temp, pp_link);
+        page_zero_pool_cnt--;
+    }
+    *pp = ppage_temp;
     return 0;
 }
 
-
-int page_alloc_share(struct Page **pp)
+/**
+ * 在空闲循环中调用：清零一页放进预清零页池
+ * Overview:
+ *     Move one page from the buddy allocator into the pre-zeroed pool.
+ *     Interrupts are off while the page is off every list, so a timer
+ *     interrupt that never returns to the idle loop cannot leak it.
+ * Post-Condition:
+ *     Return 1 if a page was added, 0 if the pool is full or memory ran out.
+ */
+int page_zero_refill(void)
 {
     struct Page *ppage_temp;
-    /* Step 1: Get a page from free memory. If fails, return the error code.*/
-    // 检查空闲链表是否为空
-    if (LIST_EMPTY(&page_free_list))
+    u_int status;
+
+    if (page_zero_pool_cnt >= PAGE_ZERO_POOL_MAX)
     {
-        return -E_NO_MEM;  // 没有空闲页，返回内存不足错误
+        return 0;
     }
 
-    /**
-     * Step 2: Initialize this page.
-     *  use `bzero`.
-     */
-    *pp = LIST_FIRST(&page_free_list);                 //get and turn for the *pp
-    bzero((void *)page2kva(*pp), BY2PG);               // bzero *pp 清零分配的页
-    LIST_REMOVE(*pp, pp_link);                         //remove allocted page from free_list.
-    return page2kva(*pp);
+    asm volatile("di %0\n\tehb" : "=r"(status) : : "memory");
+    ppage_temp = buddy_alloc(0);
+    if (ppage_temp != NULL)
+    {
+        bzero((void *)page2kva(ppage_temp), BY2PG);
+        LIST_INSERT_HEAD(&page_zero_pool, ppage_temp, pp_link);
+        page_zero_pool_cnt++;
+    }
+    if (status & SR_IE)
+    {
+        asm volatile("ei\n\tehb" : : : "memory");
+    }
+    return ppage_temp != NULL;
 }
 
-// 共享内存
-struct Page* create_share_vm(int key, size_t size)
+/**
+ * page_free_order 函数把一个阶为 order 的块还给 buddy 分配器，并与空闲的伙伴合并
+ * Overview:
+ *     Release the 2^`order`-page block starting at `pp`. While the buddy block
+ *     of the same order is also free, the two are merged into one block of
+ *     the next order. The caller must own the whole block.
+ */
+void page_free_order(struct Page *pp, u_int order)
 {
+    u_long ppn = page2ppn(pp);
+    u_long buddy;
 
-    struct Page* value = NULL;
-    value = tryHashTableFind(&ht, key, value);
-    if( value != NULL)
+    if (order > PAGE_MAX_ORDER || (ppn & ((1 << order) - 1)))
     {
-        printf(" ### find shared entry ### %x \n",value);
-        return value;
+        panic("page_free_order: bad block %x order %d\n", page2pa(pp), order);
     }
-    else
+
+    while (order < PAGE_MAX_ORDER)
     {
-        printf(" ### create_share_vm ### \n");
-        //默认申请size小于一个页先 todo
-        struct Page *p = NULL;
-        uint32_t entry_point;
-        u_long r;
-        u_long perm;
-        /*Step 1: alloc a page. */
-        // 分配一个共享内存页
-        if ((r = page_alloc(&p)) < 0)
+        buddy = ppn ^ (1 << order);
+        if (buddy + (1 << order) > npage || !(pages[buddy].pp_flags & PP_FREE) || pages[buddy].pp_order != order)
         {
-            panic("create_share_vm: page_alloc failed\n");
-            return NULL;
+            break;
         }
-        // 设置页的引用计数
-        p->pp_ref = 1;
-
-        tryHashTableInsert(&ht, key, p);
-        printf(" ####### insert shared page entry####### %x \n",p);
-        return p;
+        free_area_del(&pages[buddy]); // 伙伴也空闲，摘下来合并成更大的块
+        ppn &= ~(1 << order);
+        order++;
     }
-}
-
-//共享内存页加入当前虚拟地址中
-void* insert_share_vm(struct Env *e, struct Page *p)
-{
-    u_long perm;
-    u_long r;
-    perm = PTE_V | PTE_R;
-    /*Step 2: Use appropriate perm to set initial stack for new Env. */
-    /*Hint: The user-stack should be writable? */
-    // 将共享页插入到进程的地址空间中
-    u_int user_va = e->heap_pc;  // 保存映射的用户空间虚拟地址
-    r = page_insert(e->env_pgdir, p, user_va, perm);
-    if (r < 0)
-    {
-        printf("error,load_icode:page_insert failed\n");
-        return NULL;
-    }
-    // 更新进程的堆指针，移动到下一个页
-    e->heap_pc = e->heap_pc + BY2PG;
-    // 返回用户空间的虚拟地址（而不是内核虚拟地址）
-    return (void *)user_va;
+    free_area_add(&pages[ppn], order);
 }
 
 /**
- * page_free 函数用于将一页之前分配的内存重新加入到空闲链表中
+ * page_free 函数用于将一页之前分配的内存重新还给 buddy 分配器
  * Overview:
  *     Release a page, mark it as free if it's `pp_ref` reaches 0.
- *
- *     When to free a page, just insert it to the page_free_list.
  */
 void page_free(struct Page *pp)
 {
@@ -515,11 +678,10 @@ void page_free(struct Page *pp)
     }
 
     /* Step 2: If the `pp_ref` reaches to 0, mark this page as free and return. */
-    // 如果引用计数等于0，将此页加入空闲链表
+    // 如果引用计数等于0，将此页作为阶为 0 的块释放
     else if (pp->pp_ref == 0)
     {
-        // 将页插入到空闲链表头部
-        LIST_INSERT_HEAD(&page_free_list, pp, pp_link);
+        page_free_order(pp, 0);
         return;
     }
     else
@@ -528,6 +690,20 @@ void page_free(struct Page *pp)
     return;
 }
 
+/* 阶为 order 的空闲块个数，预清零池里的页也是空闲的，算在 0 阶里 */
+u_long page_nr_free(u_int order)
+{
+    if (order > PAGE_MAX_ORDER)
+    {
+        return 0;
+    }
+    if (order == 0)
+    {
+        return free_area[0].nr_free + page_zero_pool_cnt;
+    }
+    return free_area[order].nr_free;
+}
+
 /**
  * 地址转换和页表创建（create 为 1）
  * 在空闲链表初始化之后发挥功能，直接使用 page_alloc 函数从空闲链表中以页为单位进行内存的申请
@@ -589,6 +765,7 @@ int pgdir_walk(Pde *pgdir, u_long va, int create, Pte **ppte)
             *pgdir_entryp = page2pa(ppage) | PTE_V | PTE_R;//存的是物理地址
             // 增加页的引用计数
             ppage->pp_ref++;
+            vm_pt_pages++;
         }
     }
 
@@ -630,6 +807,9 @@ int page_insert(Pde *pgdir, struct Page *pp, u_long va, u_int perm)
 	}
 
 	if (*pgtable_entry & PTE_V) {          //当前页表项有映射
+		if ((*pgtable_entry & PTE_PGSZ) && (*pgtable_entry & PTE_PGSZ) != (perm & PTE_PGSZ)) {
+			page_demote(pgdir, va, *pgtable_entry); // 大页里只改这一页，先拆成 4KB 页
+		}
 		// 检查是否是同一个物理页
 		if (pa2page(PTE_ADDR(*pgtable_entry)) == pp) {
 			// 插入的是同一个页面,后面固定加，这里先减
@@ -641,6 +821,65 @@ int page_insert(Pde *pgdir, struct Page *pp, u_long va, u_int perm)
 	}
     *pgtable_entry = (page2pa(pp) | PERM);
     pp->pp_ref++;
+    vm_pages_mapped++;
+    return 0;
+}
+
+/**
+ * 用大页映射一整块物理连续的页
+ * Overview:
+ *      Map the block of `size` bytes starting at page `pp` (from
+ *      page_alloc_order) at `va`. size is 64 KB, 1 MB or 16 MB, and both va and
+ *      the block are naturally aligned to it. Every 4 KB page gets its own PTE
+ *      and reference as with page_insert, tagged with the page size, so that
+ *      the TLB refill can cover this block and its 2 * size aligned neighbour
+ *      with a single entry pair when the neighbour is a large page of the same
+ *      size too.
+ * Post-Condition:
+ *      Return 0 on success, -E_INVAL on a bad size or alignment, -E_NO_MEM if
+ *      a page table couldn't be allocated (pages mapped so far are unmapped).
+ */
+int page_insert_large(Pde *pgdir, struct Page *pp, u_long va, u_int perm, u_long size)
+{
+    u_int pgsz;
+    u_long off;
+    int r;
+
+    switch (size)
+    {
+    case 64 * 1024:
+        pgsz = PTE_64K;
+        break;
+    case 1024 * 1024:
+        pgsz = PTE_1M;
+        break;
+    case 16 * 1024 * 1024:
+        pgsz = PTE_16M;
+        break;
+    default:
+        return -E_INVAL;
+    }
+    if ((va | page2pa(pp)) & (size - 1))
+    {
+        return -E_INVAL;
+    }
+
+    perm = (perm & ~PTE_PGSZ) | pgsz;
+    for (off = 0; off < size; off += BY2PG)
+    {
+        if ((r = page_insert(pgdir, pp + off / BY2PG, va + off, perm)) < 0)
+        {
+            while (off > 0)
+            {
+                off -= BY2PG;
+                page_remove(pgdir, va + off);
+            }
+            return r;
+        }
+    }
+    // 这一对里原来的 4KB 项或小一号的大页项都要作废，不然会和新的大页项重叠
+    va &= ~(2 * size - 1);
+    tlb_invalidate_span(pgdir, va, va + 2 * size);
     return 0;
 }
 
@@ -696,6 +935,29 @@ void page_decref(struct Page *pp)
     }
 }
 
+/*
+ * 把 va 所在的大页拆回 4KB 页：清掉整块 PTE 的大小位，并作废 TLB 里覆盖这一对的项。
+ * 之后大页里的页可以各自修改，保证了“带大小位的 PTE 所在的整块都还在”。
+ */
+static void page_demote(Pde *pgdir, u_long va, Pte pte)
+{
+    u_long size = PTE_PGSIZE(pte);
+    u_long base = va & ~(size - 1);
+    u_long a;
+    Pte *p;
+
+    for (a = base; a < base + size; a += BY2PG)
+    {
+        pgdir_walk(pgdir, a, 0, &p);
+        if (p)
+        {
+            *p &= ~PTE_PGSZ;
+        }
+    }
+    base = va & ~(2 * size - 1);
+    tlb_invalidate_span(pgdir, base, base + 2 * size);
+}
+
 /**
  * Overview:
  *      Unmaps the physical page at virtual address `va`.
@@ -711,7 +973,11 @@ void page_remove(Pde *pgdir, u_long va)
     {
         return;
     }
-    printf("page_remove:va 0x%x  pa 0x%x\n",va,*pagetable_entry);
+    kdebug(MM, "page_remove:va 0x%x  pa 0x%x\n",va,*pagetable_entry);
+    if (*pagetable_entry & PTE_PGSZ)
+    {
+        page_demote(pgdir, va, *pagetable_entry);
+    }
 
     // 减少页的引用计数，如果为0则释放页
     page_decref(ppage);               //减引用
@@ -725,26 +991,203 @@ void page_remove(Pde *pgdir, u_long va)
 /**
  * 从tlb中删去e的va目标项
  * Overview:
- *      Update TLB.
+ *      Drop the TLB entry for `va` in env e's address space, tagged with the
+ *      ASID of e's process (threads share it). An address space whose ASID is
+ *      not of the current generation (never ran, or retired by env_free) cannot
+ *      have live entries, so nothing is done.
  */
-void tlb_invalidate(Pde *pgdir, u_long va)//
+void tlb_invalidate_env(struct Env *e, u_long va)
 {
+    if (env_asid_live(e))
+    {
+        tlb_out(PTE_ADDR(va) | (e->env_proc->env_asid & ASID_MASK));
+    }
+}
 
-    if (curenv)
+/*
+ * tlbr 会把读出的那一项的 PageMask 留在 CP0 里，而 genex.S 的快速重填直接 tlbwr，
+ * 靠 PageMask 一直是 4KB。读过 TLB 或写过大页项之后都要调用。
+ */
+static inline void tlb_reset_pagemask(void)
+{
+    mips32_set_c0(C0_PAGEMASK, PAGEMASK_4K);
+}
+
+/*
+ * 扫一遍 TLB，把与 [start, end) 有重叠的项（大页项按它的整个范围算）写成
+ * tlb_flush_all 那样的无效项。asid < 0 时不看 ASID。固定项也一起扫，被清掉的话下次 env_run 再写回。
+ */
+static void tlb_sweep(int asid, u_long start, u_long end)
+{
+    u_int i;
+    u32 entryhi = get_asid();
+    tlbhi_t hi;
+    tlblo_t lo0, lo1;
+    unsigned msk;
+    u_long vpn2, span;
+
+    for (i = 0; i < tlb_size; i++)
     {
-        // 如果有当前进程，使用进程的ASID来使TLB条目无效
-        tlb_out(PTE_ADDR(va) | GET_ENV_ASID(curenv->env_id));   // 假如不是释放当前进程，会有问题！
+        mips_tlbri2(&hi, &lo0, &lo1, &msk, i);
+        span = (msk | (2 * BY2PG - 1)) + 1; // 这一项（一对页）覆盖的字节数
+        vpn2 = hi & ~(span - 1);
+        if (vpn2 >= end || vpn2 + span <= start)
+        {
+            continue;
+        }
+        if (asid >= 0 && (hi & ASID_MASK) != asid)
+        {
+            continue;
+        }
+        mips_tlbwi2(0x80000000 + (i << 13), 0, 0, PAGEMASK_4K, i);
+    }
+    tlb_reset_pagemask();
+    set_asid(entryhi & ASID_MASK);
+    tlb_sweeps++;
+}
+
+/**
+ * 作废 e 在 [start, end) 内的所有 TLB 项
+ * Overview:
+ *      Up to tlb_size page pairs are dropped one tlbp/tlbwi at a time; a larger
+ *      range is handled by sweeping the whole TLB once, which costs tlb_size
+ *      tlbr no matter how many pages were unmapped.
+ */
+void tlb_invalidate_range(struct Env *e, u_long start, u_long end)
+{
+    u_long va;
+    u_int asid;
+
+    if (!env_asid_live(e))
+    {
+        return;
+    }
+    asid = e->env_proc->env_asid & ASID_MASK;
+    start = ROUNDDOWN(start, 2 * BY2PG);
+    end = ROUND(end, 2 * BY2PG);
+    if ((end - start) / (2 * BY2PG) > tlb_size)
+    {
+        tlb_sweep(asid, start, end);
+        return;
+    }
+    for (va = start; va < end; va += 2 * BY2PG)
+    {
+        tlb_out(va | asid);
+    }
+}
+
+/*
+ * 作废页目录 pgdir 在 [start, end) 内的 TLB 项。正在运行的进程和内核直接处理；
+ * 其它地址空间不知道属于谁，就不看 ASID 把 TLB 扫一遍。
+ */
+static void tlb_invalidate_span(Pde *pgdir, u_long start, u_long end)
+{
+    u_long va;
+
+    if (curenv && curenv->env_pgdir == pgdir)
+    {
+        tlb_invalidate_range(curenv, start, end);
+    }
+    else if (pgdir == boot_pgdir)
+    {
+        for (va = ROUNDDOWN(start, 2 * BY2PG); va < end; va += 2 * BY2PG)
+        {
+            tlb_out(va);
+        }
     }
     else
     {
-        // 没有当前进程，直接使用虚拟地址
-        tlb_out(PTE_ADDR(va));
-        printf(" PTE_ADDR(va) : %x \n", PTE_ADDR(va));
+        tlb_sweep(-1, ROUNDDOWN(start, 2 * BY2PG), ROUND(end, 2 * BY2PG));
     }
+}
+
+/**
+ * 从 tlb 中删去页目录 pgdir 里 va 的目标项
+ * Overview:
+ *      Callers that only hold a page directory end up here. The running env
+ *      and the kernel are resolved directly; for any other address space the
+ *      owner is not known, so the TLB is swept once for `va` under every ASID.
+ */
+void tlb_invalidate(Pde *pgdir, u_long va)
+{
+    tlb_invalidate_span(pgdir, va, va + BY2PG);
+}
+
+/**
+ * 解除 e 在 [start, end) 内的所有映射，TLB 只在最后按区间作废一次
+ */
+void page_remove_range(struct Env *e, u_long start, u_long end)
+{
+    u_long va;
+    Pte *pte;
+    struct Page *pp;
 
+    for (va = ROUNDDOWN(start, BY2PG); va < end; va += BY2PG)
+    {
+        if ((pp = page_lookup(e->env_pgdir, va, &pte)) == 0)
+        {
+            continue;
+        }
+        page_decref(pp);
+        *pte = 0;
+    }
+    tlb_invalidate_range(e, start, end);
 }
 
 
+/**
+ * 写时复制，由 handle_mod（TLB 修改异常）调用
+ * Overview:
+ *      A store hit a page whose TLB entry has D clear. For a PTE_COW page the
+ *      writer gets a private writable copy, or the page itself when nobody else
+ *      maps it any more. The stale TLB entry is dropped so the retried store
+ *      refills from the new PTE. A store to any other read-only page kills curenv,
+ *      and so does running out of memory for the copy.
+ */
+void page_cow_fault(u_long va, Pde *pgdir)
+{
+    Pte *pte;
+    struct Page *pp;
+    struct Page *np;
+
+    pgdir_walk(pgdir, va, 0, &pte);
+    if (pte == NULL || !(*pte & PTE_V) || !(*pte & PTE_COW))
+    {
+        print_addr_error(); // 真正写了只读页
+        return;
+    }
+    vm_cow_faults++;
+    if (curenv)
+    {
+        curenv->env_vm.cow_faults++;
+    }
+    if (*pte & PTE_PGSZ)
+    {
+        page_demote(pgdir, va, *pte); // 只有这一页会变成私有的
+    }
+
+    pp = pa2page(PTE_ADDR(*pte));
+    if (pp->pp_ref == 1)
+    {
+        // 只剩自己在用，直接改成可写
+        *pte = (*pte & ~PTE_COW) | PTE_R;
+        tlb_invalidate(pgdir, va);
+        return;
+    }
+
+    // 整页都会被覆盖，不需要先清零
+    if (page_alloc_nozero(&np) < 0)
+    {
+        // 和非法写一样只结束这个进程，env_free 不会返回，直接调度下一个
+        kerr(MM, "page_cow_fault: out of memory, env 0x%x killed\n", curenv->env_id);
+        env_free(curenv);
+        return;
+    }
+    bcopy((void *)page2kva(pp), (void *)page2kva(np), BY2PG);
+    // page_insert 会让旧页的引用减一并使 TLB 中对应的条目无效
+    page_insert(pgdir, np, ROUNDDOWN(va, BY2PG), (*pte & 0xFFF & ~PTE_COW) | PTE_R);
+}
+
 uint32_t pageout(uint32_t va, uint32_t context)
 {
     u_long r;
@@ -766,8 +1209,223 @@ uint32_t pageout(uint32_t va, uint32_t context)
     }
 
     page_insert((Pde *)context, p, VA2PFN(va), PTE_R);
-    printf("pageout: @ 0x%x @  ->pa 0x%x\n", va,page2pa(p));
-    printf("CP0HI: 0x%x status:0x%x \n",get_asid(),get_status());
+    vm_pageouts++;
+    if (curenv && curenv->env_pgdir == (Pde *)context)
+    {
+        curenv->env_vm.pageouts++;
+    }
+    kdebug(MM, "pageout: @ 0x%x @  ->pa 0x%x\n", va,page2pa(p));
+    kdebug(MM, "CP0HI: 0x%x status:0x%x \n",get_asid(),get_status());
 
     return va2pa((Pde *)context, va);
 }
+
+/* PTE 转成 EntryLo：PFN 放到 [25:6]，R(D)/V/G 放到 [2:0]，与 genex.S 中 PTE2ENTRYLO 相同 */
+static tlblo_t pte2entrylo(Pte pte)
+{
+    return ((pte >> PGSHIFT) << 6) | ((pte >> 8) & 0x7);
+}
+
+/*
+ * va 落在大页里（pte 带大小位）：这一对的两半都是同样大小的大页时，写一个覆盖整对的
+ * 大页项，返回 1；否则返回 0，由调用者按 4KB 重填（两半大小不同时只能这样）。
+ * 带大小位的 PTE 所在的整块都还映射着（page_demote 保证），所以只看每半的第一页。
+ */
+static int tlb_refill_large(u_long va, Pde *pgdir, Pte pte)
+{
+    u_long size = PTE_PGSIZE(pte);
+    u_long base = va & ~(2 * size - 1);
+    Pte *even, *odd;
+
+    pgdir_walk(pgdir, base, 0, &even);
+    pgdir_walk(pgdir, base + size, 0, &odd);
+    if (even == 0 || odd == 0 ||
+        (*even & (PTE_V | PTE_PGSZ)) != (PTE_V | (pte & PTE_PGSZ)) ||
+        (*odd & (PTE_V | PTE_PGSZ)) != (PTE_V | (pte & PTE_PGSZ)))
+    {
+        return 0;
+    }
+    mips_tlbrwr2(base | (get_asid() & 0xFF), pte2entrylo(*even), pte2entrylo(*odd), PTE_PAGEMASK(pte));
+    tlb_reset_pagemask();
+    tlb_refills_large++;
+    return 1;
+}
+
+/**
+ * TLB 重填的慢速路径，由 handle_tlb 调用
+ * Overview:
+ *      The fast refill in lib/genex.S gives up when `va` has no page table, and a PTE
+ *      it loaded without PTE_V comes back here as a TLB invalid exception. Only a
+ *      genuinely invalid PTE goes through pageout(); then the even/odd PTE pair is
+ *      written back, rewriting the matching TLB entry if there is one. The fast
+ *      path also leaves large pages (PTE_PGSZ) here, they get one entry for the
+ *      whole pair when possible.
+ */
+void tlb_refill(u_long va, Pde *pgdir)
+{
+    Pte *pte;
+    tlbhi_t hi;
+
+    pgdir_walk(pgdir, va, 0, &pte);
+    if (pte == 0 || (*pte & PTE_V) == 0)
+    {
+        pageout(va, (uint32_t)pgdir);
+        pgdir_walk(pgdir, va, 0, &pte);
+    }
+
+    if ((*pte & PTE_PGSZ) && tlb_refill_large(va, pgdir, *pte))
+    {
+        tlb_refills_slow++;
+        if (curenv && curenv->env_pgdir == pgdir)
+        {
+            curenv->env_vm.tlb_refills++;
+        }
+        return;
+    }
+    pte = (Pte *)((u_long)pte & ~0x7); // 偶数页 PTE
+    hi = (va & ~(2 * BY2PG - 1)) | (get_asid() & 0xFF);
+    mips_tlbrwr2(hi, pte2entrylo(pte[0]), pte2entrylo(pte[1]), PAGEMASK_4K);
+    tlb_refills_slow++;
+    if (curenv && curenv->env_pgdir == pgdir)
+    {
+        curenv->env_vm.tlb_refills++;
+    }
+}
+
+/*
+ * 快速路径只数全局的 tlb_refills，这里把上次结算以来的部分记到 e 头上。
+ * 切换进程（env_run）、时钟中断（sched_tick）和进入空闲前调用，中间的重填都算正在运行的进程的。
+ */
+void tlb_charge_refills(struct Env *e)
+{
+    if (e)
+    {
+        e->env_vm.tlb_refills += tlb_refills - tlb_refills_charged;
+    }
+    tlb_refills_charged = tlb_refills;
+}
+
+/**
+ * 启动时探测 TLB 大小，并用 CP0 Wired 留出 tlb_nwired 项固定项
+ * Overview:
+ *      Entries [0, Wired) are never picked by tlbwr, so the refill paths only
+ *      replace entries in [Wired, tlb_size). The wired slots hold the top
+ *      tlb_nwired page pairs of the running env's user stack, see tlb_wire_env.
+ *      At most half of the TLB is wired so random replacement keeps enough room.
+ */
+void tlb_init(void)
+{
+    tlb_size = mips_tlb_size();
+    tlb_nwired = TLB_WIRED;
+    if (tlb_nwired > tlb_size / 2)
+    {
+        tlb_nwired = tlb_size / 2;
+    }
+    tlb_flush_all();
+    mips32_set_c0(C0_WIRED, tlb_nwired);
+    kinfo(MM, "TLB: %d entries, %d wired\n", tlb_size, tlb_nwired);
+}
+
+/**
+ * 把 e 的用户栈顶的 tlb_nwired 对页写进固定项，env_run 切换进程时调用
+ * Overview:
+ *      Slot i maps the page pair just below USTACKTOP - 2 * i * BY2PG with e's
+ *      ASID. A pair whose PTEs are not valid yet is written with EntryLo 0, the
+ *      first access then takes a TLB invalid exception and tlb_refill rewrites
+ *      the slot in place. Since two TLB entries must never match the same
+ *      VPN2/ASID, a random-area copy of the pair is retired first. Clobbers
+ *      EntryHi, the caller sets the ASID afterwards.
+ */
+void tlb_wire_env(struct Env *e)
+{
+    u_int i;
+    u_long va;
+    int idx;
+    Pte *pte;
+    tlbhi_t hi;
+    tlblo_t lo0, lo1;
+    unsigned msk;
+
+    for (i = 0; i < tlb_nwired; i++)
+    {
+        va = USTACKTOP - 2 * BY2PG * (i + 1);
+        hi = va | (e->env_proc->env_asid & ASID_MASK);
+        idx = mips_tlbprobe2(hi, &lo0, &lo1, &msk);
+        if (idx >= (int)tlb_nwired)
+        {
+            // 与 tlb_flush_all 一样写成 kseg0 里的无效项
+            mips_tlbwi2(0x80000000 + (idx << 13), 0, 0, PAGEMASK_4K, idx);
+        }
+        lo0 = lo1 = 0;
+        pgdir_walk(e->env_pgdir, va, 0, &pte);
+        if (pte && ((pte[0] | pte[1]) & PTE_PGSZ))
+        {
+            // 栈映射成了大页：交给重填去写大页项，固定项留空，免得两项重叠
+            hi = 0x80000000 + (i << 13);
+        }
+        else if (pte)
+        {
+            lo0 = pte2entrylo(pte[0]);
+            lo1 = pte2entrylo(pte[1]);
+        }
+        mips_tlbwi2(hi, lo0, lo1, PAGEMASK_4K, i);
+    }
+    tlb_reset_pagemask(); // mips_tlbprobe2 命中时做过 tlbr
+    tlb_wired_writes += tlb_nwired;
+}
+
+/**
+ * 填写 sys_vm_stat 返回的计数
+ * Overview:
+ *      e's event counters are copied, and its mapped user pages and page-table
+ *      pages are counted by walking e's page directory below USHMTOP, so
+ *      attached shared memory is included.
+ */
+void vm_stat_fill(struct Env *e, struct vm_stat *st)
+{
+    u_int pdeno, pteno, i;
+    Pte *pt;
+
+    tlb_charge_refills(curenv);
+    st->env = e->env_vm;
+    st->env.pages_mapped = 0;
+    st->env.pt_pages = 0;
+    for (pdeno = 0; pdeno < PDX(USHMTOP); pdeno++)
+    {
+        if (!(e->env_pgdir[pdeno] & PTE_V))
+        {
+            continue;
+        }
+        st->env.pt_pages++;
+        pt = (Pte *)KADDR(PTE_ADDR(e->env_pgdir[pdeno]));
+        for (pteno = 0; pteno <= PTX(~0); pteno++)
+        {
+            if (pt[pteno] & PTE_V)
+            {
+                st->env.pages_mapped++;
+            }
+        }
+    }
+
+    st->tlb_refills = tlb_refills + tlb_refills_slow;
+    st->tlb_refills_slow = tlb_refills_slow;
+    st->tlb_evictions = tlb_evictions;
+    st->tlb_refills_large = tlb_refills_large;
+    st->tlb_wired_writes = tlb_wired_writes;
+    st->tlb_sweeps = tlb_sweeps;
+    st->tlb_entries = tlb_size;
+    st->tlb_wired = tlb_nwired;
+    st->asid_rollovers = asid_rollovers;
+    st->pageouts = vm_pageouts;
+    st->cow_faults = vm_cow_faults;
+    st->pages_mapped = vm_pages_mapped;
+    st->pt_pages = vm_pt_pages;
+    st->alloc_failures = page_alloc_failures;
+    st->zero_hits = page_zero_hits;
+    st->zero_misses = page_zero_misses;
+    st->zero_pool = page_zero_pool_cnt;
+    for (i = 0; i < VM_STAT_ORDERS; i++)
+    {
+        st->free_blocks[i] = page_nr_free(i);
+    }
+}
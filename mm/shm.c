@@ -0,0 +1,441 @@
+#include <shm.h>
+#include <env.h>
+#include <pmap.h>
+#include <error.h>
+#include <log.h>
+#include <hashmap.h>
+
+/*
+ * 共享内存段按 key 放在一张哈希表里（inc/hashmap.h），段的个数没有上限。
+ * 段描述符和挂接记录都很小，从整页切出来的对象池里分配，用完放回池里。
+ *
+ * 挂接时映射整个段，权限带 PTE_LIBRARY。段只挂在 [USHM, USHMTOP) 里，
+ * env_fork 复制页表时不碰这一段，而是由 shm_env_fork 给子进程逐段再挂接一次，
+ * 子进程和父进程看到的是同一份页，段的挂接计数也算上了子进程。
+ * 调用者不指定地址时，在这个窗口里按首次适应找一段空闲地址，解除挂接后地址可以再用；
+ * 物理连续的段按大页对齐放，映射时用 page_insert_large。
+ */
+#define SHM_PERM (PTE_V | PTE_R | PTE_LIBRARY)
+
+HASHMAP_DEFINE(shm_keymap, int, struct shm_seg *, hash_int, hash_eq_int)
+static struct shm_keymap shm_keys;
+
+u_int shm_nsegs;
+u_long shm_npages;
+
+union shm_obj
+{
+	struct shm_seg seg;
+	struct shm_attach at;
+	union shm_obj *next; // 在空闲池里时
+};
+
+static union shm_obj *shm_obj_free;
+
+void shm_init(void)
+{
+	shm_keymap_init(&shm_keys);
+	shm_obj_free = NULL;
+	shm_nsegs = 0;
+	shm_npages = 0;
+}
+
+// 池空了就再切一页，切出来的页不再还回去
+static union shm_obj *shm_obj_alloc(void)
+{
+	struct Page *pp;
+	union shm_obj *o;
+	u_int i;
+
+	if (shm_obj_free == NULL)
+	{
+		if (page_alloc(&pp) < 0)
+		{
+			return NULL;
+		}
+		pp->pp_ref++;
+		o = (union shm_obj *)page2kva(pp);
+		for (i = 0; i < BY2PG / sizeof(*o); i++)
+		{
+			o[i].next = shm_obj_free;
+			shm_obj_free = &o[i];
+		}
+	}
+	o = shm_obj_free;
+	shm_obj_free = o->next;
+	bzero(o, sizeof(*o));
+	return o;
+}
+
+static void shm_obj_put(void *p)
+{
+	union shm_obj *o = p;
+
+	o->next = shm_obj_free;
+	shm_obj_free = o;
+}
+
+static struct shm_seg *shm_lookup(int key)
+{
+	struct shm_seg **ps = shm_keymap_get(&shm_keys, key);
+
+	return ps ? *ps : NULL;
+}
+
+static struct Page *shm_page(struct shm_seg *s, u_int i)
+{
+	return s->shm_block ? s->shm_block + i : s->shm_pages[i];
+}
+
+// 放掉段自己持有的页引用，归还描述符
+static void shm_destroy(struct shm_seg *s)
+{
+	struct Page *pp;
+	u_int i;
+
+	kdebug(SHM, "shm: destroy key %d, %d pages\n", s->shm_key, s->shm_npages);
+	shm_keymap_del(&shm_keys, s->shm_key);
+	for (i = 0; (s->shm_block || s->shm_pages) && i < s->shm_npages; i++)
+	{ // 连页指针数组都没分到时，段里一页也没有
+		if ((pp = shm_page(s, i)) != NULL)
+		{
+			page_decref(pp);
+		}
+	}
+	if (s->shm_pages)
+	{
+		page_decref(pa2page(PADDR(s->shm_pages)));
+	}
+	shm_nsegs--;
+	shm_npages -= s->shm_npages;
+	shm_obj_put(s);
+}
+
+/*
+ * 新建一个 npages 页的段，页都已清零，每页由段持有一个引用。
+ * 先试物理连续的块，块比段大的部分逐页还给 buddy；拿不到再逐页分配。
+ */
+static int shm_create(int key, u_int npages, struct shm_seg **ps)
+{
+	union shm_obj *o;
+	struct shm_seg *s;
+	struct Page *pp;
+	u_int order, i;
+
+	if ((o = shm_obj_alloc()) == NULL)
+	{
+		return -E_NO_MEM;
+	}
+	s = &o->seg;
+	s->shm_key = key;
+	s->shm_npages = npages;
+	if (shm_keymap_put(&shm_keys, key, s) < 0)
+	{
+		shm_obj_put(o);
+		return -E_NO_MEM;
+	}
+	shm_nsegs++;
+	shm_npages += npages;
+
+	for (order = 0; (1u << order) < npages; order++)
+	{
+	}
+	if (page_alloc_order_nozero(&pp, order) == 0)
+	{
+		for (i = npages; i < (1u << order); i++)
+		{
+			page_free(pp + i);
+		}
+		bzero((void *)page2kva(pp), npages * BY2PG); // 只清留下的页，还回去的尾巴不用清
+		for (i = 0; i < npages; i++)
+		{
+			pp[i].pp_ref = 1;
+		}
+		s->shm_block = pp;
+	}
+	else
+	{
+		if (page_alloc(&pp) < 0)
+		{
+			shm_destroy(s);
+			return -E_NO_MEM;
+		}
+		pp->pp_ref++;
+		s->shm_pages = (struct Page **)page2kva(pp);
+		for (i = 0; i < npages; i++)
+		{
+			if (page_alloc(&pp) < 0)
+			{ // 没分到的槽还是 NULL，shm_destroy 会跳过
+				shm_destroy(s);
+				return -E_NO_MEM;
+			}
+			pp->pp_ref++;
+			s->shm_pages[i] = pp;
+		}
+	}
+	kdebug(SHM, "shm: create key %d, %d pages, %s\n", key, npages, s->shm_block ? "contiguous" : "scattered");
+	*ps = s;
+	return 0;
+}
+
+// va 和 pa 都对齐、剩余长度也够的最大页面大小（段不超过 4MB，只用到 1MB）
+static u_long shm_large_size(u_long va, u_long pa, u_long len)
+{
+	u_long size;
+
+	for (size = 1024 * 1024; size > BY2PG; size >>= 4)
+	{
+		if (size <= len && !((va | pa) & (size - 1)))
+		{
+			return size;
+		}
+	}
+	return BY2PG;
+}
+
+// 把整个段映射到 e 的 va 处，中途失败的话已映射的部分撤掉
+static int shm_map(struct Env *e, struct shm_seg *s, u_long va)
+{
+	u_long len = s->shm_npages * BY2PG;
+	u_long off, size;
+	int r;
+
+	for (off = 0; off < len; off += size)
+	{
+		size = BY2PG;
+		if (s->shm_block)
+		{
+			size = shm_large_size(va + off, page2pa(s->shm_block) + off, len - off);
+		}
+		if (size > BY2PG)
+		{
+			r = page_insert_large(e->env_pgdir, s->shm_block + off / BY2PG, va + off, SHM_PERM, size);
+		}
+		else
+		{
+			r = page_insert(e->env_pgdir, shm_page(s, off / BY2PG), va + off, SHM_PERM);
+		}
+		if (r < 0)
+		{
+			page_remove_range(e, va, va + off);
+			return r;
+		}
+	}
+	return 0;
+}
+
+// 在 [USHM, USHMTOP) 里首次适应找 len 字节、按 align 对齐的空闲地址，没有就返回 0
+static u_long shm_find_va(struct Env *e, u_long len, u_long align)
+{
+	struct shm_attach *a;
+	u_long va = USHM;
+	u_long end;
+
+	LIST_FOREACH(a, &e->env_shm, sa_link)
+	{
+		end = a->sa_va + a->sa_seg->shm_npages * BY2PG;
+		if (end <= va)
+		{
+			continue;
+		}
+		if (a->sa_va >= va + len)
+		{
+			break;
+		}
+		va = ROUND(end, align);
+	}
+	return va + len <= USHMTOP ? va : 0;
+}
+
+// 调用者指定的地址：页对齐，整段都在 [USHM, USHMTOP) 里，并且还没有映射
+static int shm_va_ok(struct Env *e, u_long va, u_long len)
+{
+	u_long a;
+
+	if ((va & (BY2PG - 1)) || va < USHM || va + len < va || va + len > USHMTOP)
+	{
+		return 0;
+	}
+	for (a = va; a < va + len; a += BY2PG)
+	{
+		if (page_lookup(e->env_pgdir, a, 0))
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// 按地址升序挂到 e->env_shm 上，shm_find_va 依赖这个顺序
+static void shm_link(struct Env *e, struct shm_attach *at)
+{
+	struct shm_attach *a, *prev = NULL;
+
+	LIST_FOREACH(a, &e->env_shm, sa_link)
+	{
+		if (a->sa_va > at->sa_va)
+		{
+			break;
+		}
+		prev = a;
+	}
+	if (prev)
+	{
+		LIST_INSERT_AFTER(prev, at, sa_link);
+	}
+	else
+	{
+		LIST_INSERT_HEAD(&e->env_shm, at, sa_link);
+	}
+}
+
+/* Overview:
+ *  Attach the segment named `key` to e at `va`, creating it with `size` bytes
+ *  if it doesn't exist yet. An existing segment is attached whole and must be
+ *  at least `size` bytes; size 0 only attaches an existing one. The segment
+ *  goes in [USHM, USHMTOP); with va 0 the kernel picks the address there.
+ *
+ * Post-Condition:
+ *  Return 0 and store the address in *pva on success. Return -E_INVAL on a bad
+ *  size or address (unaligned, outside the window or already mapped), -E_NO_MEM if
+ *  memory or kernel-chosen address space ran out.
+ */
+int shm_attach(struct Env *e, int key, u_long size, u_long va, u_long *pva)
+{
+	struct shm_seg *s;
+	union shm_obj *o;
+	u_int npages = ROUND(size, BY2PG) / BY2PG;
+	u_long len;
+	int r;
+
+	if (size > SHM_MAX_PAGES * BY2PG)
+	{
+		return -E_INVAL;
+	}
+	if ((s = shm_lookup(key)) == NULL)
+	{
+		if (npages == 0)
+		{
+			return -E_INVAL;
+		}
+		if ((r = shm_create(key, npages, &s)) < 0)
+		{
+			return r;
+		}
+	}
+	else if (npages > s->shm_npages)
+	{
+		return -E_INVAL;
+	}
+
+	len = s->shm_npages * BY2PG;
+	if (va == 0)
+	{
+		va = shm_find_va(e, len, s->shm_block ? shm_large_size(USHM, page2pa(s->shm_block), len) : BY2PG);
+		r = va ? 0 : -E_NO_MEM;
+	}
+	else
+	{
+		r = shm_va_ok(e, va, len) ? 0 : -E_INVAL;
+	}
+	if (r == 0 && (o = shm_obj_alloc()) == NULL)
+	{
+		r = -E_NO_MEM;
+	}
+	if (r == 0 && (r = shm_map(e, s, va)) < 0)
+	{
+		shm_obj_put(o);
+	}
+	if (r < 0)
+	{
+		if (s->shm_nattach == 0)
+		{ // 刚建的段一次都没挂上，不留
+			shm_destroy(s);
+		}
+		return r;
+	}
+
+	o->at.sa_seg = s;
+	o->at.sa_va = va;
+	shm_link(e, &o->at);
+	s->shm_nattach++;
+	kdebug(SHM, "shm: env 0x%x attach key %d at 0x%x\n", e->env_id, key, va);
+	*pva = va;
+	return 0;
+}
+
+static void shm_put(struct shm_seg *s)
+{
+	if (--s->shm_nattach == 0)
+	{
+		shm_destroy(s);
+	}
+}
+
+/* Overview:
+ *  Detach the segment e attached at `va`, the address shm_attach returned.
+ *  The segment is destroyed when this was its last attachment.
+ *
+ * Post-Condition:
+ *  Return 0 on success, -E_INVAL if nothing is attached at va.
+ */
+int shm_detach(struct Env *e, u_long va)
+{
+	struct shm_attach *a;
+
+	LIST_FOREACH(a, &e->env_shm, sa_link)
+	{
+		if (a->sa_va == va)
+		{
+			break;
+		}
+	}
+	if (a == NULL)
+	{
+		return -E_INVAL;
+	}
+	kdebug(SHM, "shm: env 0x%x detach key %d at 0x%x\n", e->env_id, a->sa_seg->shm_key, va);
+	page_remove_range(e, va, va + a->sa_seg->shm_npages * BY2PG);
+	LIST_REMOVE(a, sa_link);
+	shm_put(a->sa_seg);
+	shm_obj_put(a);
+	return 0;
+}
+
+/* Overview:
+ *  Give the new child of a fork the same attachments as its parent, at the
+ *  same addresses. Each one goes through shm_attach, so the child holds its
+ *  own attach record and counts in shm_nattach like any other attacher.
+ *
+ * Post-Condition:
+ *  Return 0 on success, < 0 if an attach failed; the attachments made so far
+ *  are left on the child for shm_env_free to drop.
+ */
+int shm_env_fork(struct Env *child, struct Env *parent)
+{
+	struct shm_attach *a;
+	u_long va;
+	int r;
+
+	LIST_FOREACH(a, &parent->env_shm, sa_link)
+	{
+		if ((r = shm_attach(child, a->sa_seg->shm_key, 0, a->sa_va, &va)) < 0)
+		{
+			return r;
+		}
+	}
+	return 0;
+}
+
+// 进程退出时放掉它的所有挂接；映射不在这里拆，由 env_free 连同页表一起清
+void shm_env_free(struct Env *e)
+{
+	struct shm_attach *a;
+
+	while ((a = LIST_FIRST(&e->env_shm)) != NULL)
+	{
+		LIST_REMOVE(a, sa_link);
+		shm_put(a->sa_seg);
+		shm_obj_put(a);
+	}
+}
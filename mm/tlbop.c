@@ -18,5 +18,7 @@ void print_tlb()
         mips_tlbri2(&phi, &plo0, &plo1, &pmsk, i);
         printf("%d hi %x lo0 %x lo1 %x pmsk %x\n", i, phi, plo0, plo1, pmsk);
     }
+    mips32_set_c0(C0_PAGEMASK, PAGEMASK_4K); // tlbr 改了 PageMask，快速重填要的是 4KB
+
 }
 
@@ -0,0 +1,308 @@
+/*
+ * inc/hashmap.h 的主机测试和基准，用主机的 cc 编译（见 tests/Makefile）：
+ *   ./hashmap_test        跑测试
+ *   ./hashmap_test -b     跑基准，和 HASHMAP_MIGRATE 等参数一起调
+ * 表的内存用 calloc，和页分配器一样是清零的；同时记着没还的字节数，查泄漏。
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static long hm_bytes; // 分配出去还没释放的字节数
+static int hm_fail;	  // 非 0 时下一次分配失败
+
+static void *test_alloc(u_long bytes)
+{
+	if (hm_fail)
+	{
+		hm_fail = 0;
+		return NULL;
+	}
+	hm_bytes += bytes;
+	return calloc(1, bytes);
+}
+
+static void test_free(void *p, u_long bytes)
+{
+	hm_bytes -= bytes;
+	free(p);
+}
+
+#define HASHMAP_ALLOC test_alloc
+#define HASHMAP_FREE test_free
+#include <hashmap.h>
+
+HASHMAP_DEFINE(imap, u_int, u_int, hash_int, hash_eq_int)
+HASHMAP_DEFINE(smap, const char *, int, hash_str, hash_eq_str)
+
+static int failures;
+
+#define CHECK(cond)                                                        \
+	do                                                                     \
+	{                                                                      \
+		if (!(cond))                                                       \
+		{                                                                  \
+			printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+			failures++;                                                    \
+		}                                                                  \
+	} while (0)
+
+static void test_put_get_del(void)
+{
+	struct imap m;
+	u_int i;
+
+	imap_init(&m);
+	CHECK(imap_get(&m, 1) == NULL);
+	CHECK(imap_del(&m, 1) == 0);
+	CHECK(hm_bytes == 0); // 第一次 put 之前不分配
+
+	for (i = 0; i < 100; i++)
+	{
+		CHECK(imap_put(&m, i, i * 10) == 0);
+	}
+	CHECK(imap_size(&m) == 100);
+	for (i = 0; i < 100; i++)
+	{
+		CHECK(imap_get(&m, i) && *imap_get(&m, i) == i * 10);
+	}
+	CHECK(imap_get(&m, 100) == NULL);
+
+	// 覆盖不改变个数
+	CHECK(imap_put(&m, 7, 70000) == 0);
+	CHECK(imap_size(&m) == 100);
+	CHECK(*imap_get(&m, 7) == 70000);
+
+	for (i = 0; i < 100; i += 2)
+	{
+		CHECK(imap_del(&m, i) == 1);
+	}
+	CHECK(imap_del(&m, 0) == 0);
+	CHECK(imap_size(&m) == 50);
+	for (i = 0; i < 100; i++)
+	{
+		CHECK((imap_get(&m, i) != NULL) == (i % 2 == 1));
+	}
+
+	imap_destroy(&m);
+	CHECK(imap_size(&m) == 0 && m.tab == NULL);
+	CHECK(hm_bytes == 0);
+}
+
+static void test_tombstones(void)
+{
+	struct imap m;
+	u_int i, cap;
+
+	imap_init(&m);
+	// 孤立的一个元素删掉后面就是空槽，墓碑马上清掉
+	CHECK(imap_put(&m, 42, 1) == 0);
+	CHECK(imap_del(&m, 42) == 1);
+	CHECK(m.tombs == 0 && m.used == 0);
+
+	// 插满再倒着删：每删一个，它和前面连着的墓碑都变回空槽
+	for (i = 0; i < 64; i++)
+	{
+		CHECK(imap_put(&m, i, i) == 0);
+	}
+	while (m.old != NULL)
+	{
+		imap_migrate(&m, ~0u);
+	}
+	for (i = 0; i < 64; i++)
+	{
+		CHECK(imap_del(&m, i) == 1);
+	}
+	CHECK(imap_size(&m) == 0);
+	CHECK(m.used == 0);
+	for (i = 0, cap = 0; i < m.cap; i++)
+	{
+		cap += m.tab[i].st == HM_TOMB;
+	}
+	CHECK(cap == m.tombs); // 计数和表里实际的墓碑一致
+
+	// 反复插删不同的键，元素个数不变，表不应该一直变大
+	cap = m.cap;
+	for (i = 0; i < 100000; i++)
+	{
+		CHECK(imap_put(&m, 1000 + i, i) == 0);
+		if (i >= 8)
+		{
+			CHECK(imap_del(&m, 1000 + i - 8) == 1);
+		}
+	}
+	CHECK(imap_size(&m) == 8);
+	CHECK(m.cap == cap);
+	for (i = 100000 - 8; i < 100000; i++)
+	{
+		CHECK(imap_get(&m, 1000 + i) && *imap_get(&m, 1000 + i) == i);
+	}
+	imap_destroy(&m);
+	CHECK(hm_bytes == 0);
+}
+
+static void test_incremental_resize(void)
+{
+	struct imap m;
+	u_int i, n, old_cap;
+
+	imap_init(&m);
+	for (n = 0; m.old == NULL || m.old_cap == 0; n++)
+	{
+		CHECK(imap_put(&m, n, ~n) == 0);
+	}
+	// 刚换表：两张表都有元素
+	old_cap = m.old_cap;
+	CHECK(m.cap == old_cap * 2);
+	CHECK(m.used > 0 && m.size > m.used);
+	for (i = 0; i < n; i++)
+	{
+		CHECK(imap_get(&m, i) && *imap_get(&m, i) == ~i);
+	}
+
+	// 还在旧表里的键：覆盖、删除都要看得到
+	for (i = 0; i < n && imap_probe(m.old, m.old_cap, i) == NULL; i++)
+	{
+	}
+	CHECK(i < n);
+	CHECK(imap_put(&m, i, 12345) == 0);
+	CHECK(*imap_get(&m, i) == 12345);
+	for (i++; i < n && imap_probe(m.old, m.old_cap, i) == NULL; i++)
+	{
+	}
+	CHECK(i < n);
+	CHECK(imap_del(&m, i) == 1);
+	CHECK(imap_get(&m, i) == NULL);
+	CHECK(imap_size(&m) == n - 1);
+
+	// 每次修改只搬 HASHMAP_MIGRATE 个槽，接着插入直到旧表搬完
+	while (m.old != NULL)
+	{
+		CHECK(m.old_pos <= m.old_cap);
+		CHECK(imap_put(&m, n, ~n) == 0);
+		n++;
+	}
+	CHECK(imap_size(&m) == n - 1);
+	for (i = 0; i < n; i++)
+	{
+		if (imap_get(&m, i) == NULL)
+		{
+			continue;
+		}
+		CHECK(*imap_get(&m, i) == ~i || *imap_get(&m, i) == 12345);
+	}
+	CHECK(hm_bytes == (long)(m.cap * sizeof(*m.tab)));
+
+	// 换表时分配失败：put 报错，原来的内容不受影响
+	while ((m.used + m.tombs + 1) * 4 <= m.cap * 3)
+	{
+		CHECK(imap_put(&m, n, ~n) == 0);
+		n++;
+	}
+	hm_fail = 1;
+	CHECK(imap_put(&m, n, ~n) == -E_NO_MEM);
+	CHECK(imap_get(&m, n) == NULL);
+	CHECK(imap_get(&m, n - 1) && *imap_get(&m, n - 1) == ~(n - 1));
+	imap_destroy(&m);
+	CHECK(hm_bytes == 0);
+}
+
+static void test_hashers(void)
+{
+	struct smap m;
+	char a[16], b[16];
+	int i;
+
+	// 相邻整数散开，FNV-1a 的已知值
+	CHECK(hash_u32(1) != hash_u32(2));
+	CHECK((hash_u32(1) & 63) != (hash_u32(2) & 63) || (hash_u32(2) & 63) != (hash_u32(3) & 63));
+	CHECK(hash_str("") == 2166136261u);
+	CHECK(hash_str("a") == 0xe40c292cu);
+	CHECK(hash_eq_str("abc", "abc") && !hash_eq_str("abc", "abd") && !hash_eq_str("ab", "abc"));
+
+	// 字符串键按内容比较，不按指针
+	smap_init(&m);
+	for (i = 0; i < 1000; i++)
+	{
+		snprintf(a, sizeof(a), "key%d", i);
+		CHECK(smap_put(&m, strdup(a), i) == 0);
+	}
+	for (i = 0; i < 1000; i++)
+	{
+		snprintf(b, sizeof(b), "key%d", i);
+		CHECK(smap_get(&m, b) && *smap_get(&m, b) == i);
+	}
+	CHECK(smap_get(&m, "key1000") == NULL);
+	CHECK(smap_del(&m, "key500") == 1);
+	CHECK(smap_get(&m, "key500") == NULL);
+	CHECK(smap_size(&m) == 999);
+	smap_destroy(&m); // 键是 strdup 出来的，测试进程退出时一起还
+	CHECK(hm_bytes == 0);
+}
+
+static double elapsed_ns(clock_t start, u_int ops)
+{
+	return (double)(clock() - start) * 1e9 / CLOCKS_PER_SEC / ops;
+}
+
+static void bench(void)
+{
+	struct imap m;
+	clock_t t;
+	u_int i, n, sum = 0;
+
+	for (n = 1000; n <= 1000000; n *= 10)
+	{
+		imap_init(&m);
+		t = clock();
+		for (i = 0; i < n; i++)
+		{
+			imap_put(&m, i * 7919, i);
+		}
+		printf("n=%7u  put %6.1f ns", n, elapsed_ns(t, n));
+		t = clock();
+		for (i = 0; i < n; i++)
+		{
+			sum += *imap_get(&m, i * 7919);
+		}
+		printf("  get hit %6.1f ns", elapsed_ns(t, n));
+		t = clock();
+		for (i = 0; i < n; i++)
+		{
+			sum += imap_get(&m, i * 7919 + 1) != NULL;
+		}
+		printf("  get miss %6.1f ns", elapsed_ns(t, n));
+		t = clock();
+		for (i = 0; i < n; i++)
+		{
+			imap_del(&m, i * 7919);
+		}
+		printf("  del %6.1f ns  (cap %u)\n", elapsed_ns(t, n), m.cap);
+		imap_destroy(&m);
+	}
+	if (sum == 1)
+	{ // 不让编译器把 get 优化掉
+		printf("\n");
+	}
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 1 && strcmp(argv[1], "-b") == 0)
+	{
+		bench();
+		return 0;
+	}
+	test_put_get_del();
+	test_tombstones();
+	test_incremental_resize();
+	test_hashers();
+	if (failures)
+	{
+		printf("hashmap_test: %d failures\n", failures);
+		return 1;
+	}
+	printf("hashmap_test: ok\n");
+	return 0;
+}
@@ -0,0 +1,4 @@
+#pragma once
+
+// 主机的 C 库也有 error.h，-I host 排在前面，这里转到内核的错误码
+#include "../../inc/error.h"
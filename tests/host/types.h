@@ -0,0 +1,19 @@
+#pragma once
+
+/*
+ * 在主机上编译内核头文件用的 types.h：inc/types.h 把 size_t、uintptr_t 定成 32 位，
+ * 和主机的 C 库冲突，这里只给出内核头文件用到的那些类型名，其余都取主机的。
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+
+typedef unsigned long u_long;
+typedef unsigned int u_int;
+typedef unsigned short u_short;
+typedef unsigned char u_char;
+typedef unsigned long long u_ll;
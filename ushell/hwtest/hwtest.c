@@ -19,10 +19,9 @@
 #define LED_ID      0
 #define SEG_ID      1
 
-/* 简单延时 */
+/* 延时 count * 50 ms，睡眠期间不占用 CPU */
 static void delay(int count) {
-    volatile int i;
-    for (i = 0; i < count * 100000; i++);
+    syscall_sleep_ms(count * 50);
 }
 
 /* 计算开关中有多少位为 1 */
@@ -44,6 +44,9 @@ extern int msyscall(int, int, int, int, int, int);
 void syscall_putchar(char ch);
 u_int syscall_getenvid(void);
 void* syscall_get_shm(int key, int size);
+void* syscall_shm_at(int key, int size, void *va);
+int syscall_shm_detach(void *va);
+int syscall_pthread_create(void *func, int arg);
 void syscall_env_create(char* binary,int pt,char*argv);
 int syscall_set_pgfault_handler(u_int envid, void (*func)(void),
 								u_int xstacktop);
@@ -83,6 +86,11 @@ int syscall_rt_release_device(u32 device_id, u32 num);
 int syscall_rt_claim_device(u32 * req);
 int syscall_rt_write_by_num(u32 device_id, u32 num, char *buf);
 void syscall_set_buzzer(u32 val);
+int syscall_fork(void);
+int syscall_sleep_ms(u_int ms);
+struct vm_stat;
+int syscall_vm_stat(u_int envid, struct vm_stat *buf);
+int syscall_kstat(u_int what);
 
 
 // string.c
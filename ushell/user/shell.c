@@ -12,6 +12,8 @@
 
 // #include <console.h>
 #include "lib.h"
+#include <vmstat.h>
+#include <kstat.h>
 // #include "syscall_lib.h"
 // max size of file image is 16M
 #define MAX_FILE_SIZE 0x1000000
@@ -41,7 +43,9 @@ static struct Command commands[] = {
     { "mkdir", "Create directory", mon_mkdir },
 	{ "read", "Read a file", mon_read },
 	{ "write", "Change a file", mon_write },
-	{ "rm", "Delete files or directories", mon_rm } //，
+	{ "rm", "Delete files or directories", mon_rm }, //，
+	{ "vmstat", "Show VM counters (vmstat [envid])", mon_vmstat },
+	{ "kstat", "Show kernel counters (kstat [workq|disk|irq|cons])", mon_kstat }
 };
 
 
@@ -204,6 +208,81 @@ int mon_write(int argc, char **argv, struct Trapframe *tf){
 	return syscall_fwrite(argv[1], argv[2]);
 }
 
+/***** VM statistics *****/
+int mon_vmstat(int argc, char **argv, struct Trapframe *tf)
+{
+	struct vm_stat st;
+	u_int envid = 0;
+	int i;
+
+	if (argc > 1)
+	{
+		envid = strtol(argv[1], 0, 0);
+	}
+	if (syscall_vm_stat(envid, &st) < 0)
+	{
+		syscall_printf("vmstat: bad envid %s\n", argv[1]);
+		return -1;
+	}
+	syscall_printf("env 0x%x:\n", envid ? envid : syscall_getenvid());
+	syscall_printf("  tlb refills %d  pageouts %d  cow faults %d\n",
+				   st.env.tlb_refills, st.env.pageouts, st.env.cow_faults);
+	syscall_printf("  pages mapped %d  page tables %d\n", st.env.pages_mapped, st.env.pt_pages);
+	syscall_printf("global:\n");
+	syscall_printf("  tlb %d entries (%d wired)  wired writes %d  sweeps %d  asid rollovers %d\n",
+				   st.tlb_entries, st.tlb_wired, st.tlb_wired_writes, st.tlb_sweeps, st.asid_rollovers);
+	syscall_printf("  tlb refills %d (slow %d, large %d)  evictions %d\n",
+				   st.tlb_refills, st.tlb_refills_slow, st.tlb_refills_large, st.tlb_evictions);
+	syscall_printf("  pageouts %d  cow faults %d\n", st.pageouts, st.cow_faults);
+	syscall_printf("  pages mapped %d  page tables %d  alloc failures %d\n",
+				   st.pages_mapped, st.pt_pages, st.alloc_failures);
+	syscall_printf("  zero pool %d pages  hits %d  misses %d\n", st.zero_pool, st.zero_hits, st.zero_misses);
+	syscall_printf("  free blocks by order:");
+	for (i = 0; i < VM_STAT_ORDERS; i++)
+	{
+		syscall_printf(" %d", st.free_blocks[i]);
+	}
+	syscall_printf("\n");
+	return 0;
+}
+
+/***** Kernel statistics *****/
+static const struct
+{
+	const char *name;
+	u_int what;
+} kstat_names[] = {
+	{ "workq", KSTAT_WORKQ },
+	{ "disk", KSTAT_DISK },
+	{ "irq", KSTAT_IRQ },
+	{ "cons", KSTAT_CONS },
+};
+
+// 不带参数时打印全部
+int mon_kstat(int argc, char **argv, struct Trapframe *tf)
+{
+	u_int what = argc > 1 ? 0 : KSTAT_ALL;
+	int i, j;
+
+	for (i = 1; i < argc; i++)
+	{
+		for (j = 0; j < ARRAY_SIZE(kstat_names); j++)
+		{
+			if (strcmp(argv[i], kstat_names[j].name) == 0)
+			{
+				what |= kstat_names[j].what;
+				break;
+			}
+		}
+		if (j == ARRAY_SIZE(kstat_names))
+		{
+			syscall_printf("kstat: unknown counter group %s\n", argv[i]);
+			return -1;
+		}
+	}
+	return syscall_kstat(what);
+}
+
 char* Int2String(int num,char *str)//10进制
 {
     int i = 0;//指示填充str
@@ -23,6 +23,8 @@ int mon_debug(int args, char * argc[]);
 int mon_cd(int argc, char **argv, struct Trapframe *tf);
 int mon_read(int argc, char **argv, struct Trapframe *tf);
 int mon_write(int argc, char **argv, struct Trapframe *tf);
+int mon_vmstat(int argc, char **argv, struct Trapframe *tf);
+int mon_kstat(int argc, char **argv, struct Trapframe *tf);
 char* Int2String(int num,char *str);
 int test_banker();
 int run(char *buf, struct Trapframe *tf);
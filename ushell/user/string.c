@@ -92,40 +92,33 @@ char *strfind(const char *s, char c) {
 	return (char *) s;
 }
 
-void *memset(void *v, int c, size_t n) {
-	char *p;
-	int m;
-
-	p = v;
-	m = n;
-	while (--m >= 0)
-		*p++ = c;
-
-	return v;
-}
-
+// memcpy/memset/bcopy/bzero 与内核共用 lib/string_asm.S。
+// memcpy 是正向拷贝，dst 不落在 (src, src + n) 内时可以直接交给它。
 void *memmove(void *dst, const void *src, size_t n) {
 	const char *s;
 	char *d;
 
 	s = src;
 	d = dst;
-	if (s < d && s + n > d) {
-		s += n;
-		d += n;
-		while (n-- > 0)
-			*--d = *--s;
+	if (!(s < d && s + n > d))
+		return memcpy(dst, src, n);
+
+	s += n;
+	d += n;
+	if ((((uint32_t)s | (uint32_t)d | n) & 3) == 0) {
+		while (n > 0) {
+			s -= 4;
+			d -= 4;
+			*(uint32_t *)d = *(const uint32_t *)s;
+			n -= 4;
+		}
 	} else
 		while (n-- > 0)
-			*d++ = *s++;
+			*--d = *--s;
 
 	return dst;
 }
 
-void *memcpy(void *dst, const void *src, size_t n) {
-	return memmove(dst, src, n);
-}
-
 int memcmp(const void *v1, const void *v2, size_t n) {
 	const uint8_t *s1 = (const uint8_t *) v1;
 	const uint8_t *s2 = (const uint8_t *) v2;
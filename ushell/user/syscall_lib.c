@@ -12,11 +12,23 @@ u_int syscall_getenvid(void)
 	return msyscall(SYS_getenvid, 0, 0, 0, 0, 0);
 }
 
-// 共享内存系统调用
+// 共享内存系统调用：挂接 key 对应的段（不存在就按 size 新建），地址由内核选
 void* syscall_get_shm(int key, int size)
 {
 	return msyscall(SYS_get_shm, key, size, 0, 0, 0);
 }
+
+// 同上，但挂接在页对齐的 va 处
+void* syscall_shm_at(int key, int size, void *va)
+{
+	return msyscall(SYS_get_shm, key, size, (int)va, 0, 0);
+}
+
+// 解除 va 处的挂接，最后一个挂接解除时段被销毁
+int syscall_shm_detach(void *va)
+{
+	return msyscall(SYS_shm_detach, (int)va, 0, 0, 0, 0);
+}
 // load elf创建进程的系统调用
 void syscall_env_create(char* binary,int pt,char*argv)
 {
@@ -43,10 +55,39 @@ int syscall_mem_unmap(u_int envid, u_int va)
 	return msyscall(SYS_mem_unmap, envid, va, 0, 0, 0);
 }
 
-//创建线程
-void syscall_pthread_create(void *func, int arg)
+// 写时复制 fork：父进程返回子进程 envid，子进程返回 0
+int syscall_fork(void)
+{
+	return msyscall(SYS_fork, 0, 0, 0, 0, 0);
+}
+
+int fork(void)
+{
+	return syscall_fork();
+}
+
+// 睡眠至少 ms 毫秒，期间不占用 CPU
+int syscall_sleep_ms(u_int ms)
+{
+	return msyscall(SYS_sleep_ms, ms, 0, 0, 0, 0);
+}
+
+// 取 envid（0 表示自己）和全局的虚存计数，见 vmstat.h
+int syscall_vm_stat(u_int envid, struct vm_stat *buf)
+{
+	return msyscall(SYS_vm_stat, envid, (int)buf, 0, 0, 0);
+}
+
+// 让内核在控制台上打印 what 选中的计数，见 kstat.h
+int syscall_kstat(u_int what)
+{
+	return msyscall(SYS_kstat, what, 0, 0, 0, 0);
+}
+
+// 创建与本进程共用地址空间的线程，返回线程的 envid，出错返回负数
+int syscall_pthread_create(void *func, int arg)
 {
-	msyscall(SYS_pthread_create, func, arg, 0, 0, 0);
+	return msyscall(SYS_pthread_create, func, arg, 0, 0, 0);
 }
 
 int syscall_set_env_status(u_int envid, u_int status)